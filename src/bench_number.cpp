@@ -0,0 +1,83 @@
+// compares the reader's real number parsing and printing with strtod and
+// ostringstream; pass a file of whitespace separated numbers, or nothing
+// to use a generated data set
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+#include "number.hpp"
+
+using namespace mu;
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string> texts;
+  if (argc > 1)
+  {
+    std::ifstream in(argv[1]);
+    std::string t;
+    while (in >> t)
+      texts.push_back(t);
+  }
+  else
+  {
+    // sensor style readings, prices and a tail of arbitrary doubles
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> reading(-500, 500);
+    std::ostringstream os;
+    for (int i = 0; i < 1000000; ++i)
+    {
+      os.str("");
+      if (i % 10 < 6)
+        os << int(reading(rng) * 100) / 100.0;
+      else if (i % 10 < 9)
+        os << reading(rng) * 1e6;
+      else
+        os << std::scientific << reading(rng) * 1e-30;
+      texts.push_back(os.str());
+    }
+  }
+
+  std::vector<double> ours(texts.size()), theirs(texts.size());
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < texts.size(); ++i)
+    ParseReal(texts[i].data(), texts[i].data() + texts[i].size(), ours[i]);
+  double parse = Seconds(start);
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < texts.size(); ++i)
+    theirs[i] = strtod(texts[i].c_str(), nullptr);
+  double parseStrtod = Seconds(start);
+  size_t mismatches = 0;
+  for (size_t i = 0; i < texts.size(); ++i)
+    mismatches += ours[i] != theirs[i];
+
+  size_t bytes = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ours.size(); ++i)
+    bytes += FormatReal(ours[i]).size();
+  double format = Seconds(start);
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ours.size(); ++i)
+  {
+    std::ostringstream os;
+    os.precision(17);
+    os << ours[i];
+    bytes += os.str().size();
+  }
+  double formatStream = Seconds(start);
+
+  std::cout << texts.size() << " numbers, " << mismatches << " parse mismatches\n"
+            << "ParseReal  " << parse << "s   strtod        " << parseStrtod << "s\n"
+            << "FormatReal " << format << "s   ostringstream " << formatStream << "s\n";
+  return mismatches != 0;
+}
@@ -0,0 +1,395 @@
+#include "bigint.hpp"
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace mu;
+
+BigInt::BigInt(int64_t n)
+: m_negative(n < 0)
+{
+  uint64_t mag = m_negative ? uint64_t(-(n + 1)) + 1 : uint64_t(n);
+  while (mag)
+  {
+    m_limbs.push_back(uint32_t(mag));
+    mag >>= 32;
+  }
+}
+
+bool BigInt::Parse(const std::string& s, BigInt& out)
+{
+  size_t i = 0;
+  bool negative = false;
+  if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+    negative = s[i++] == '-';
+  if (i == s.size())
+    return false;
+  Limbs limbs;
+  while (i < s.size())
+  {
+    // fold in up to 9 digits at a time: limbs = limbs * 10^k + chunk
+    uint32_t chunk = 0, scale = 1;
+    for (int k = 0; k < 9 && i < s.size(); ++k, ++i)
+    {
+      if (s[i] < '0' || s[i] > '9')
+        return false;
+      chunk = chunk * 10 + (s[i] - '0');
+      scale *= 10;
+    }
+    uint64_t carry = chunk;
+    for (size_t j = 0; j < limbs.size(); ++j)
+    {
+      uint64_t t = uint64_t(limbs[j]) * scale + carry;
+      limbs[j] = uint32_t(t);
+      carry = t >> 32;
+    }
+    if (carry)
+      limbs.push_back(uint32_t(carry));
+  }
+  Trim(limbs);
+  out.m_limbs.swap(limbs);
+  out.m_negative = negative && !out.m_limbs.empty();
+  return true;
+}
+
+std::string BigInt::ToString() const
+{
+  if (m_limbs.empty())
+    return "0";
+  // peel off 9 decimal digits at a time, least significant first
+  Limbs mag(m_limbs);
+  std::vector<uint32_t> chunks;
+  while (!mag.empty())
+  {
+    uint64_t rem = 0;
+    for (size_t i = mag.size(); i--; )
+    {
+      uint64_t cur = (rem << 32) | mag[i];
+      mag[i] = uint32_t(cur / 1000000000);
+      rem = cur % 1000000000;
+    }
+    Trim(mag);
+    chunks.push_back(uint32_t(rem));
+  }
+  std::string s(m_negative ? "-" : "");
+  s += std::to_string(chunks.back());
+  for (size_t i = chunks.size() - 1; i--; )
+  {
+    std::string digits(std::to_string(chunks[i]));
+    s.append(9 - digits.size(), '0');
+    s += digits;
+  }
+  return s;
+}
+
+bool BigInt::ToInt64(int64_t& n) const
+{
+  if (m_limbs.size() > 2)
+    return false;
+  uint64_t mag = 0;
+  for (size_t i = m_limbs.size(); i--; )
+    mag = (mag << 32) | m_limbs[i];
+  if (!m_negative)
+  {
+    if (mag > uint64_t(INT64_MAX))
+      return false;
+    n = int64_t(mag);
+    return true;
+  }
+  if (mag > uint64_t(INT64_MAX) + 1)
+    return false;
+  n = mag == uint64_t(INT64_MAX) + 1 ? INT64_MIN : -int64_t(mag);
+  return true;
+}
+
+double BigInt::ToDouble() const
+{
+  // strtod rounds correctly; bignums only get here when mixed with reals
+  return strtod(ToString().c_str(), nullptr);
+}
+
+BigInt mu::operator+(const BigInt& a, const BigInt& b)
+{
+  BigInt r;
+  if (a.m_negative == b.m_negative)
+  {
+    r.m_limbs = BigInt::AddMagnitude(a.m_limbs, b.m_limbs);
+    r.m_negative = a.m_negative;
+  }
+  else if (BigInt::CompareMagnitude(a.m_limbs, b.m_limbs) >= 0)
+  {
+    r.m_limbs = BigInt::SubMagnitude(a.m_limbs, b.m_limbs);
+    r.m_negative = a.m_negative;
+  }
+  else
+  {
+    r.m_limbs = BigInt::SubMagnitude(b.m_limbs, a.m_limbs);
+    r.m_negative = b.m_negative;
+  }
+  r.m_negative = r.m_negative && !r.m_limbs.empty();
+  return r;
+}
+
+BigInt mu::operator-(const BigInt& a, const BigInt& b)
+{
+  BigInt negated(b);
+  negated.m_negative = !b.m_negative && !b.IsZero();
+  return a + negated;
+}
+
+BigInt mu::operator*(const BigInt& a, const BigInt& b)
+{
+  BigInt r;
+  r.m_limbs = BigInt::MulMagnitude(a.m_limbs.data(), a.m_limbs.size(), b.m_limbs.data(), b.m_limbs.size());
+  BigInt::Trim(r.m_limbs);
+  r.m_negative = a.m_negative != b.m_negative && !r.m_limbs.empty();
+  return r;
+}
+
+void BigInt::DivMod(const BigInt& a, const BigInt& b, BigInt& quotient, BigInt& remainder)
+{
+  Limbs q, r;
+  DivModMagnitude(a.m_limbs, b.m_limbs, q, r);
+  quotient.m_limbs.swap(q);
+  quotient.m_negative = a.m_negative != b.m_negative && !quotient.m_limbs.empty();
+  remainder.m_limbs.swap(r);
+  remainder.m_negative = a.m_negative && !remainder.m_limbs.empty();
+}
+
+int BigInt::Compare(const BigInt& a, const BigInt& b)
+{
+  if (a.m_negative != b.m_negative)
+    return a.m_negative ? -1 : 1;
+  int c = CompareMagnitude(a.m_limbs, b.m_limbs);
+  return a.m_negative ? -c : c;
+}
+
+int BigInt::CompareMagnitude(const Limbs& a, const Limbs& b)
+{
+  if (a.size() != b.size())
+    return a.size() < b.size() ? -1 : 1;
+  for (size_t i = a.size(); i--; )
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+  return 0;
+}
+
+BigInt::Limbs BigInt::AddMagnitude(const Limbs& a, const Limbs& b)
+{
+  const Limbs& longer = a.size() >= b.size() ? a : b;
+  const Limbs& shorter = a.size() >= b.size() ? b : a;
+  Limbs r(longer.size() + 1);
+  uint64_t carry = 0;
+  for (size_t i = 0; i < longer.size(); ++i)
+  {
+    uint64_t t = uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0) + carry;
+    r[i] = uint32_t(t);
+    carry = t >> 32;
+  }
+  r[longer.size()] = uint32_t(carry);
+  Trim(r);
+  return r;
+}
+
+BigInt::Limbs BigInt::SubMagnitude(const Limbs& a, const Limbs& b)
+{
+  Limbs r(a.size());
+  int64_t borrow = 0;
+  for (size_t i = 0; i < a.size(); ++i)
+  {
+    int64_t t = int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+    borrow = t < 0;
+    r[i] = uint32_t(t + (borrow << 32));
+  }
+  Trim(r);
+  return r;
+}
+
+namespace {
+
+// r[offset...] += x, with r long enough to absorb the carry
+void AddAt(BigInt::Limbs& r, const BigInt::Limbs& x, size_t offset)
+{
+  uint64_t carry = 0;
+  size_t i = 0;
+  for (; i < x.size(); ++i)
+  {
+    uint64_t t = uint64_t(r[offset + i]) + x[i] + carry;
+    r[offset + i] = uint32_t(t);
+    carry = t >> 32;
+  }
+  for (; carry; ++i)
+  {
+    uint64_t t = uint64_t(r[offset + i]) + carry;
+    r[offset + i] = uint32_t(t);
+    carry = t >> 32;
+  }
+}
+
+// the sum of two untrimmed limb ranges
+BigInt::Limbs AddRanges(const uint32_t* a, size_t n, const uint32_t* b, size_t m)
+{
+  BigInt::Limbs r(std::max(n, m) + 1);
+  uint64_t carry = 0;
+  for (size_t i = 0; i < r.size() - 1; ++i)
+  {
+    uint64_t t = (i < n ? a[i] : 0) + uint64_t(i < m ? b[i] : 0) + carry;
+    r[i] = uint32_t(t);
+    carry = t >> 32;
+  }
+  r.back() = uint32_t(carry);
+  return r;
+}
+
+// r -= x, where r >= x
+void SubInPlace(BigInt::Limbs& r, const BigInt::Limbs& x)
+{
+  int64_t borrow = 0;
+  for (size_t i = 0; i < r.size() && (i < x.size() || borrow); ++i)
+  {
+    int64_t t = int64_t(r[i]) - (i < x.size() ? x[i] : 0) - borrow;
+    borrow = t < 0;
+    r[i] = uint32_t(t + (borrow << 32));
+  }
+}
+
+}
+
+BigInt::Limbs BigInt::MulMagnitude(const uint32_t* a, size_t n, const uint32_t* b, size_t m)
+{
+  if (n < m)
+  {
+    std::swap(a, b);
+    std::swap(n, m);
+  }
+  if (m == 0)
+    return Limbs();
+  Limbs r(n + m);
+  if (m < KaratsubaThreshold)
+  {
+    // schoolbook
+    for (size_t j = 0; j < m; ++j)
+    {
+      uint64_t carry = 0, bj = b[j];
+      if (!bj)
+        continue;
+      for (size_t i = 0; i < n; ++i)
+      {
+        uint64_t t = a[i] * bj + r[i + j] + carry;
+        r[i + j] = uint32_t(t);
+        carry = t >> 32;
+      }
+      r[j + n] = uint32_t(carry);
+    }
+    return r;
+  }
+  const size_t h = n / 2;
+  if (m <= h)
+  {
+    // too lopsided to split both: a1 * b << h + a0 * b
+    AddAt(r, MulMagnitude(a, h, b, m), 0);
+    AddAt(r, MulMagnitude(a + h, n - h, b, m), h);
+    return r;
+  }
+  // Karatsuba: with a = a1 B^h + a0 and b = b1 B^h + b0,
+  // a b = z2 B^2h + ((a0 + a1)(b0 + b1) - z2 - z0) B^h + z0
+  Limbs z0(MulMagnitude(a, h, b, h));
+  Limbs z2(MulMagnitude(a + h, n - h, b + h, m - h));
+  Limbs sa(AddRanges(a, h, a + h, n - h));
+  Limbs sb(AddRanges(b, h, b + h, m - h));
+  Limbs z1(MulMagnitude(sa.data(), sa.size(), sb.data(), sb.size()));
+  SubInPlace(z1, z0);
+  SubInPlace(z1, z2);
+  Trim(z0);
+  Trim(z1);
+  Trim(z2);
+  AddAt(r, z0, 0);
+  AddAt(r, z1, h);
+  AddAt(r, z2, 2 * h);
+  return r;
+}
+
+void BigInt::DivModMagnitude(const Limbs& u, const Limbs& v, Limbs& q, Limbs& r)
+{
+  q.clear();
+  r.clear();
+  if (CompareMagnitude(u, v) < 0)
+  {
+    r = u;
+    return;
+  }
+  const size_t n = v.size(), m = u.size();
+  if (n == 1)
+  {
+    q.resize(m);
+    uint64_t rem = 0;
+    for (size_t i = m; i--; )
+    {
+      uint64_t cur = (rem << 32) | u[i];
+      q[i] = uint32_t(cur / v[0]);
+      rem = cur % v[0];
+    }
+    Trim(q);
+    if (rem)
+      r.push_back(uint32_t(rem));
+    return;
+  }
+  // Knuth's algorithm D, normalising so the divisor's top limb has its high bit set
+  const int s = __builtin_clz(v[n - 1]);
+  Limbs vn(n), un(m + 1);
+  for (size_t i = n; i--; )
+    vn[i] = uint32_t((((uint64_t(v[i]) << 32) | (i ? v[i - 1] : 0)) << s) >> 32);
+  un[m] = uint32_t((uint64_t(u[m - 1]) << s) >> 32);
+  for (size_t i = m; i--; )
+    un[i] = uint32_t((((uint64_t(u[i]) << 32) | (i ? u[i - 1] : 0)) << s) >> 32);
+  q.resize(m - n + 1);
+  const uint64_t base = uint64_t(1) << 32;
+  for (size_t j = m - n + 1; j--; )
+  {
+    uint64_t num = (uint64_t(un[j + n]) << 32) | un[j + n - 1];
+    uint64_t qhat = num / vn[n - 1];
+    uint64_t rhat = num % vn[n - 1];
+    while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2]))
+    {
+      --qhat;
+      rhat += vn[n - 1];
+      if (rhat >= base)
+        break;
+    }
+    // un[j..j+n] -= qhat * vn
+    int64_t k = 0, t;
+    for (size_t i = 0; i < n; ++i)
+    {
+      uint64_t p = qhat * vn[i];
+      t = int64_t(un[i + j]) - k - int64_t(p & 0xFFFFFFFF);
+      un[i + j] = uint32_t(t);
+      k = int64_t(p >> 32) - (t >> 32);
+    }
+    t = int64_t(un[j + n]) - k;
+    un[j + n] = uint32_t(t);
+    q[j] = uint32_t(qhat);
+    if (t < 0)
+    {
+      // qhat was one too large: add the divisor back
+      --q[j];
+      uint64_t carry = 0;
+      for (size_t i = 0; i < n; ++i)
+      {
+        uint64_t sum = uint64_t(un[i + j]) + vn[i] + carry;
+        un[i + j] = uint32_t(sum);
+        carry = sum >> 32;
+      }
+      un[j + n] = uint32_t(un[j + n] + carry);
+    }
+  }
+  Trim(q);
+  r.resize(n);
+  for (size_t i = 0; i < n; ++i)
+    r[i] = uint32_t(((uint64_t(un[i + 1]) << 32) | un[i]) >> s);
+  Trim(r);
+}
+
+void BigInt::Trim(Limbs& limbs)
+{
+  while (!limbs.empty() && !limbs.back())
+    limbs.pop_back();
+}
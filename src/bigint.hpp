@@ -0,0 +1,75 @@
+#ifndef __MU_BIGINT_HPP__
+#define __MU_BIGINT_HPP__
+
+#include "cell.hpp"
+#include <stdint.h>
+
+namespace mu {
+
+// an immutable arbitrary precision integer: sign and magnitude, the
+// magnitude in base 2^32 limbs, least significant first, no leading zeros
+class BigInt : public Object
+{
+public:
+  typedef std::vector<uint32_t> Limbs;
+
+  BigInt()
+  : m_negative(false)
+  {
+  }
+
+  explicit BigInt(int64_t n);
+
+  // parse an optionally signed decimal integer; false if s is not one
+  static bool Parse(const std::string& s, BigInt& out);
+
+  std::string ToString() const;
+
+  bool IsZero() const
+  {
+    return m_limbs.empty();
+  }
+
+  bool IsNegative() const
+  {
+    return m_negative;
+  }
+
+  // true if the value fits in an int64_t, which is then stored in n
+  bool ToInt64(int64_t& n) const;
+
+  // the nearest double
+  double ToDouble() const;
+
+  friend BigInt operator+(const BigInt& a, const BigInt& b);
+  friend BigInt operator-(const BigInt& a, const BigInt& b);
+  friend BigInt operator*(const BigInt& a, const BigInt& b);
+
+  // truncating division; b must not be zero
+  static void DivMod(const BigInt& a, const BigInt& b, BigInt& quotient, BigInt& remainder);
+
+  // -1, 0 or 1 as a is less than, equal to or greater than b
+  static int Compare(const BigInt& a, const BigInt& b);
+
+  // magnitudes of at least this many limbs are multiplied with Karatsuba
+  static const size_t KaratsubaThreshold = 40;
+
+private:
+  static int CompareMagnitude(const Limbs& a, const Limbs& b);
+  static Limbs AddMagnitude(const Limbs& a, const Limbs& b);
+  static Limbs SubMagnitude(const Limbs& a, const Limbs& b); // requires a >= b
+  static Limbs MulMagnitude(const uint32_t* a, size_t n, const uint32_t* b, size_t m);
+  static void DivModMagnitude(const Limbs& a, const Limbs& b, Limbs& q, Limbs& r);
+  static void Trim(Limbs& limbs);
+
+  bool m_negative;
+  Limbs m_limbs;
+};
+
+BigInt operator+(const BigInt& a, const BigInt& b);
+BigInt operator-(const BigInt& a, const BigInt& b);
+BigInt operator*(const BigInt& a, const BigInt& b);
+
+}
+
+#endif
@@ -1,4 +1,7 @@
 #include "cell.hpp"
+#include "bigint.hpp"
+#include "number.hpp"
+#include <stdlib.h>
 
 using namespace mu;
 
@@ -7,8 +10,8 @@ std::string Cell::ToString() const
   if (GetType() == List) 
   {
     std::string s("(");
-    for (Cell::iter e = GetList().begin(); e != GetList().end(); ++e)
-      s += e->ToString() + ' ';
+    for (size_t i = 0; i < ListSize(); ++i)
+      s += ListAt(i).ToString() + ' ';
     if (s[s.size() - 1] == ' ')
       s.erase(s.size() - 1);
     return s + ')';
@@ -17,6 +20,170 @@ std::string Cell::ToString() const
     return "<Lambda>";
   else if (GetType() == Proc)
     return "<Proc>";
+  else if (GetType() == Boolean)
+    return GetBoolVal() ? "#t" : "#f";
+  else if (GetType() == Future)
+    return "<Future>";
+  else if (GetType() == Pending)
+    return "<Pending>";
+  else if (GetType() == Promise)
+    return "<Promise>";
+  else if (GetType() != Number && m_obj)
+    return m_obj->ToString();
   return GetVal();
 }
 
+
+void Cell::ParseNumber()
+{
+  BigInt n;
+  double x;
+  if (ParseFixnum(m_val, m_fixnum))
+    m_kind = Fixnum;
+  else if (BigInt::Parse(m_val, n))
+  {
+    if (n.ToInt64(m_fixnum))
+      m_kind = Fixnum;
+    else
+    {
+      m_kind = Bignum;
+      m_obj = std::make_shared<BigInt>(n);
+    }
+  }
+  else if (ParseReal(m_val.data(), m_val.data() + m_val.size(), x))
+    SetReal(x);
+  else
+    m_fixnum = atol(m_val.c_str());
+  m_val.clear();
+}
+
+std::string Cell::NumberToString() const
+{
+  if (m_kind == Fixnum)
+    return std::to_string(m_fixnum);
+  if (m_kind == Real)
+    return FormatReal(m_real);
+  return GetObject<BigInt>()->ToString();
+}
+
+void ListStore::PushBack(const Cell& c)
+{
+  Changed();
+  bool number = c.GetType() == Number;
+  if (m_strategy == Empty && number && c.IsFixnum())
+  {
+    m_strategy = Ints;
+    m_ints.reserve(m_reserve);
+  }
+  else if (m_strategy == Empty && number && c.IsReal())
+  {
+    m_strategy = Reals;
+    m_reals.reserve(m_reserve);
+  }
+
+  if (m_strategy == Ints && number && c.IsFixnum())
+    m_ints.push_back(c.GetFixnum());
+  else if (m_strategy == Reals && number && c.IsReal())
+    m_reals.push_back(c.GetReal());
+  else
+  {
+    Box();
+    m_cells.push_back(c);
+  }
+}
+
+void ListStore::Append(const ListStore& other)
+{
+  if (other.m_strategy == Empty)
+    return;
+  Changed();
+  if (m_strategy == Empty)
+    m_strategy = other.m_strategy;
+  if (m_strategy == other.m_strategy)
+  {
+    m_ints.insert(m_ints.end(), other.m_ints.begin(), other.m_ints.end());
+    m_reals.insert(m_reals.end(), other.m_reals.begin(), other.m_reals.end());
+    m_cells.insert(m_cells.end(), other.m_cells.begin(), other.m_cells.end());
+    return;
+  }
+  Box();
+  m_cells.reserve(m_cells.size() + other.Size());
+  for (size_t i = 0; i < other.Size(); ++i)
+    m_cells.push_back(other.At(i));
+}
+
+void ListStore::Reserve(size_t n)
+{
+  if (m_strategy == Empty)
+    m_reserve = n;
+  else if (m_strategy == Ints)
+    m_ints.reserve(n);
+  else if (m_strategy == Reals)
+    m_reals.reserve(n);
+  else
+    m_cells.reserve(n);
+}
+
+std::shared_ptr<ListStore> ListStore::Slice(size_t begin, size_t end) const
+{
+  std::shared_ptr<ListStore> result(std::make_shared<ListStore>());
+  if (begin >= end)
+    return result;
+  result->m_strategy = m_strategy;
+  if (m_strategy == Ints)
+    result->m_ints.assign(m_ints.begin() + begin, m_ints.begin() + end);
+  else if (m_strategy == Reals)
+    result->m_reals.assign(m_reals.begin() + begin, m_reals.begin() + end);
+  else
+    result->m_cells.assign(m_cells.begin() + begin, m_cells.begin() + end);
+  return result;
+}
+
+const std::vector<Cell>& ListStore::GetBoxed() const
+{
+  if (m_strategy == Empty || m_strategy == Boxed)
+    return m_cells;
+  if (!m_mirrored.load(std::memory_order_acquire))
+  {
+    std::lock_guard<std::mutex> lock(m_mirrorLock);
+    if (!m_mirrored.load(std::memory_order_relaxed))
+    {
+      m_mirror.clear();
+      m_mirror.reserve(Size());
+      for (size_t i = 0; i < Size(); ++i)
+        m_mirror.push_back(At(i));
+      m_mirrored.store(true, std::memory_order_release);
+    }
+  }
+  return m_mirror;
+}
+
+std::vector<Cell>& ListStore::GetBoxed()
+{
+  Changed();
+  Box();
+  return m_cells;
+}
+
+// move the elements to m_cells; a no-op once the list is boxed
+void ListStore::Box()
+{
+  if (m_strategy == Boxed)
+    return;
+  m_cells.reserve(Size() > m_reserve ? Size() : m_reserve);
+  for (size_t i = 0; i < Size(); ++i)
+    m_cells.push_back(At(i));
+  std::vector<int64_t>().swap(m_ints);
+  std::vector<double>().swap(m_reals);
+  m_strategy = Boxed;
+}
+
+// drop the boxed copy made for readers of an unboxed list
+void ListStore::Changed()
+{
+  if (m_mirrored.load(std::memory_order_relaxed))
+  {
+    std::vector<Cell>().swap(m_mirror);
+    m_mirrored.store(false, std::memory_order_relaxed);
+  }
+}
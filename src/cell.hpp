@@ -4,6 +4,10 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
 
 namespace mu {
 
@@ -15,27 +19,70 @@ enum CellType
   Proc, 
   Lambda,
   String,
-  Boolean
+  Boolean,
+  Future,
+  Pending,
+  F64Vector,
+  S64Vector,
+  Promise,
+  HashTable,
+  PersistentMap,
+  Vector,
+  Record,
+  Guarded
+};
+
+// how a Number cell holds its value
+enum NumberKind
+{
+  Fixnum,   // a 64-bit integer in the Cell
+  Bignum,   // a BigInt on the heap
+  Real      // a double in the Cell
 };
 
 struct Env; // forward declaration; Cell and Env reference each other
+class ListStore;
+
+// base class for values that live on the heap and are shared by every
+// copy of the Cell that refers to them (futures, packed vectors, ...)
+class Object
+{
+public:
+  virtual ~Object()
+  {
+  }
+
+  // the printed form, for types Cell::ToString does not know about
+  virtual std::string ToString() const
+  {
+    return "<Object>";
+  }
+};
 
 // a variant that can hold any kind of lisp value
 class Cell 
 {
 public:
   typedef Cell (*ProcType)(const std::vector<Cell> &);
+  // fixed arity primitives take their arguments directly, so calling
+  // them does not need an argument vector
+  typedef Cell (*Proc1Type)(const Cell &);
+  typedef Cell (*Proc2Type)(const Cell &, const Cell &);
+  typedef Cell (*Proc3Type)(const Cell &, const Cell &, const Cell &);
   typedef std::vector<Cell>::const_iterator iter;
   typedef std::map<std::string, Cell> map;
 
   Cell(CellType type = Symbol) 
-  : m_type(type), m_env(nullptr) 
+  : m_type(type), m_kind(Fixnum), m_fixnum(0), m_env(nullptr) 
   {
   }
 
+  // a Number is parsed from its decimal text
   Cell(CellType type, const std::string& val) 
-  : m_type(type), m_val(val), m_env(nullptr) 
+  : m_type(type), m_val(val), m_kind(Fixnum), m_fixnum(0), m_env(nullptr) 
   {
+    if (type == Number)
+      ParseNumber();
   }
 
   Cell(bool boolVal)
@@ -44,15 +91,78 @@ public:
   }
 
   Cell(ProcType proc) 
-  : m_type(Proc), m_proc(proc), m_env(nullptr) 
+  : m_type(Proc), m_proc(proc), m_arity(-1), m_env(nullptr) 
+  {
+  }
+
+  // a fixed arity primitive; 'variadic', if given, handles calls with
+  // any other number of arguments
+  Cell(Proc1Type proc, ProcType variadic = nullptr)
+  : m_type(Proc), m_proc(variadic), m_proc1(proc), m_arity(1), m_env(nullptr)
+  {
+  }
+
+  Cell(Proc2Type proc, ProcType variadic = nullptr)
+  : m_type(Proc), m_proc(variadic), m_proc2(proc), m_arity(2), m_env(nullptr)
+  {
+  }
+
+  Cell(Proc3Type proc, ProcType variadic = nullptr)
+  : m_type(Proc), m_proc(variadic), m_proc3(proc), m_arity(3), m_env(nullptr)
+  {
+  }
+
+  Cell(CellType type, const std::shared_ptr<Object>& obj)
+  : m_type(type), m_kind(Bignum), m_proc(nullptr), m_arity(-1), m_env(nullptr), m_obj(obj)
   {
   }
 
   std::string GetVal() const
   {
+    if (m_type == Number && m_val.empty())
+      return NumberToString();
+    if (m_type == String && m_obj)
+      return m_obj->ToString(); // a Rope
     return m_val;
   }
 
+  NumberKind GetNumberKind() const
+  {
+    return m_kind;
+  }
+
+  bool IsFixnum() const
+  {
+    return m_kind == Fixnum;
+  }
+
+  bool IsReal() const
+  {
+    return m_kind == Real;
+  }
+
+  int64_t GetFixnum() const
+  {
+    return m_fixnum;
+  }
+
+  void SetFixnum(int64_t n)
+  {
+    m_kind = Fixnum;
+    m_fixnum = n;
+  }
+
+  double GetReal() const
+  {
+    return m_real;
+  }
+
+  void SetReal(double x)
+  {
+    m_kind = Real;
+    m_real = x;
+  }
+
   bool GetBoolVal() const
   {
     return m_boolVal;
@@ -73,19 +183,48 @@ public:
     m_type = type;
   }
 
-  const std::vector<Cell>& GetList() const
+  // the elements of a List or Lambda. copies of a Cell share them until
+  // one of the copies changes them
+  size_t ListSize() const;
+  Cell ListAt(size_t i) const;
+  void PushBack(const Cell& c);
+
+  // nullptr for an empty list and for any other type
+  ListStore* GetListStore() const;
+  ListStore& MutableList();
+
+  // the elements as Cells; empty for types that are not lists
+  const std::vector<Cell>& GetList() const;
+  // for changing the elements in place; gives up the unboxed
+  // representation for good
+  std::vector<Cell>& GetMutableList();
+
+  // the primitive's variadic entry, or nullptr for a NativeProc or a
+  // primitive that only has a fixed arity entry
+  ProcType GetProc() const
   {
-    return m_list;
+    return m_proc;
   }
 
-  std::vector<Cell>& GetList()
+  // the number of arguments the fixed arity entry takes, or -1 if none
+  int GetArity() const
   {
-    return m_list;
+    return m_arity;
   }
 
-  ProcType GetProc() const
+  Proc1Type GetProc1() const
   {
-    return m_proc;
+    return m_proc1;
+  }
+
+  Proc2Type GetProc2() const
+  {
+    return m_proc2;
+  }
+
+  Proc3Type GetProc3() const
+  {
+    return m_proc3;
   }
 
   Env* GetEnv() const
@@ -98,20 +237,211 @@ public:
     m_env = env;
   }
 
+  // the shared heap payload; T must match what GetType() says it holds
+  template <class T>
+  T* GetObject() const
+  {
+    return static_cast<T*>(m_obj.get());
+  }
+
+  const std::shared_ptr<Object>& GetSharedObject() const
+  {
+    return m_obj;
+  }
+
   std::string ToString() const;
   
 private:
+  void ParseNumber();
+  std::string NumberToString() const;
+
+
   CellType m_type;
   std::string m_val;
+  NumberKind m_kind;
   bool m_boolVal;
-  std::vector<Cell> m_list;
   ProcType m_proc;
+  union
+  {
+    Proc1Type m_proc1;
+    Proc2Type m_proc2;
+    Proc3Type m_proc3;
+    int64_t m_fixnum;
+    double m_real;
+  };
+  int m_arity;
   Env* m_env;
+  std::shared_ptr<Object> m_obj;
 };
 
 typedef std::vector<Cell> Cells;
 typedef Cells::const_iterator Cellit;
 
+// the elements of a list. while every element is a fixnum, or every one
+// is a real, they are kept unboxed in a plain vector, which is about a
+// tenth of the size of a vector of Cells; the first element that does
+// not fit moves the list to Cells for good
+class ListStore : public Object
+{
+public:
+  enum Strategy { Empty, Ints, Reals, Boxed };
+
+  ListStore()
+  : m_strategy(Empty), m_reserve(0), m_mirrored(false), m_interned(false), m_hash(0)
+  {
+  }
+
+  // a list of exactly these fixnums or reals
+  explicit ListStore(const std::vector<int64_t>& ints)
+  : m_strategy(ints.empty() ? Empty : Ints), m_reserve(0), m_ints(ints), m_mirrored(false),
+    m_interned(false), m_hash(0)
+  {
+  }
+
+  explicit ListStore(const std::vector<double>& reals)
+  : m_strategy(reals.empty() ? Empty : Reals), m_reserve(0), m_reals(reals), m_mirrored(false),
+    m_interned(false), m_hash(0)
+  {
+  }
+
+  // a copy is never interned, so it can be changed
+  ListStore(const ListStore& other)
+  : Object(), m_strategy(other.m_strategy), m_reserve(0), m_ints(other.m_ints),
+    m_reals(other.m_reals), m_cells(other.m_cells), m_mirrored(false), m_interned(false), m_hash(0)
+  {
+  }
+
+  Strategy GetStrategy() const
+  {
+    return m_strategy;
+  }
+
+  size_t Size() const
+  {
+    switch (m_strategy)
+    {
+    case Ints:  return m_ints.size();
+    case Reals: return m_reals.size();
+    case Boxed: return m_cells.size();
+    default:    return 0;
+    }
+  }
+
+  Cell At(size_t i) const
+  {
+    Cell c(Number);
+    if (m_strategy == Ints)
+      c.SetFixnum(m_ints[i]);
+    else if (m_strategy == Reals)
+      c.SetReal(m_reals[i]);
+    else
+      return m_cells[i];
+    return c;
+  }
+
+  void PushBack(const Cell& c);
+  void Append(const ListStore& other);
+  // room for n elements in whichever representation the list ends up with
+  void Reserve(size_t n);
+  // a new store holding elements [begin, end)
+  std::shared_ptr<ListStore> Slice(size_t begin, size_t end) const;
+
+  const std::vector<int64_t>& GetInts() const
+  {
+    return m_ints;
+  }
+
+  const std::vector<double>& GetReals() const
+  {
+    return m_reals;
+  }
+
+  // the elements as Cells. an unboxed list builds a boxed copy the first
+  // time it is asked for, which is then kept until the list changes
+  const std::vector<Cell>& GetBoxed() const;
+  std::vector<Cell>& GetBoxed();
+
+  // an interned list is the one shared copy of its value in the
+  // hash-consing table (see hashcons.hpp): it is never changed in place
+  // again, and its hash is kept
+  bool IsInterned() const
+  {
+    return m_interned.load(std::memory_order_acquire);
+  }
+
+  uint64_t GetHash() const
+  {
+    return m_hash;
+  }
+
+  void SetInterned(uint64_t hash)
+  {
+    m_hash = hash;
+    m_interned.store(true, std::memory_order_release);
+  }
+
+private:
+  ListStore& operator=(const ListStore&);
+  void Box();
+  void Changed();
+
+  Strategy m_strategy;
+  size_t m_reserve; // asked for while the list was still Empty
+  std::vector<int64_t> m_ints;
+  std::vector<double> m_reals;
+  std::vector<Cell> m_cells;
+  mutable std::mutex m_mirrorLock;
+  mutable std::atomic<bool> m_mirrored;
+  mutable std::vector<Cell> m_mirror;
+  std::atomic<bool> m_interned;
+  uint64_t m_hash;
+};
+
+inline ListStore* Cell::GetListStore() const
+{
+  if (m_type != List && m_type != Lambda)
+    return nullptr;
+  return static_cast<ListStore*>(m_obj.get());
+}
+
+inline ListStore& Cell::MutableList()
+{
+  ListStore* store = GetListStore();
+  if (!store)
+    m_obj = std::make_shared<ListStore>();
+  else if (m_obj.use_count() > 1 || store->IsInterned())
+    m_obj = std::make_shared<ListStore>(*store);
+  return *static_cast<ListStore*>(m_obj.get());
+}
+
+inline size_t Cell::ListSize() const
+{
+  ListStore* store = GetListStore();
+  return store ? store->Size() : 0;
+}
+
+inline Cell Cell::ListAt(size_t i) const
+{
+  return GetListStore()->At(i);
+}
+
+inline void Cell::PushBack(const Cell& c)
+{
+  MutableList().PushBack(c);
+}
+
+inline const std::vector<Cell>& Cell::GetList() const
+{
+  static const std::vector<Cell> empty;
+  ListStore* store = GetListStore();
+  return store ? static_cast<const ListStore*>(store)->GetBoxed() : empty;
+}
+
+inline std::vector<Cell>& Cell::GetMutableList()
+{
+  return MutableList().GetBoxed();
+}
+
 inline Cell MakeBool(bool val) 
 {
   Cell c(Boolean);
@@ -0,0 +1,151 @@
+#include "cellvec.hpp"
+#include "number.hpp"
+#include <iostream>
+
+using namespace mu;
+
+std::string VectorData::ToString() const
+{
+  Cells data(Elements());
+  std::string s("#(");
+  for (size_t i = 0; i < data.size(); ++i)
+    s += (i ? " " : "") + data[i].ToString();
+  return s + ')';
+}
+
+size_t VectorData::Size() const
+{
+  SpawnedLock lock(m_mutex);
+  return m_data.size();
+}
+
+bool VectorData::Get(size_t i, Cell& value) const
+{
+  SpawnedLock lock(m_mutex);
+  if (i >= m_data.size())
+    return false;
+  value = m_data[i];
+  return true;
+}
+
+bool VectorData::Set(size_t i, const Cell& value)
+{
+  SpawnedLock lock(m_mutex);
+  if (i >= m_data.size())
+    return false;
+  m_data[i] = value;
+  return true;
+}
+
+void VectorData::Push(const Cell& value)
+{
+  SpawnedLock lock(m_mutex);
+  m_data.push_back(value);
+}
+
+Cells VectorData::Elements() const
+{
+  SpawnedLock lock(m_mutex);
+  return m_data;
+}
+
+namespace {
+
+VectorData& Data(const Cell& v)
+{
+  if (v.GetType() != Vector)
+  {
+    std::cout << "vector expected: " << v.ToString() << "\n";
+    exit(1);
+  }
+  return *v.GetObject<VectorData>();
+}
+
+Cell Make(const std::shared_ptr<VectorData>& data)
+{
+  return Cell(Vector, data);
+}
+
+size_t Index(const Cell& i)
+{
+  if (i.GetType() != Number || !i.IsFixnum() || i.GetFixnum() < 0)
+    return size_t(-1);
+  return size_t(i.GetFixnum());
+}
+
+void OutOfRange(const Cell& i)
+{
+  std::cout << "index out of range: " << i.ToString() << "\n";
+  exit(1);
+}
+
+Cell proc_vector(const Cells & c)
+{
+  return Make(std::make_shared<VectorData>(c));
+}
+
+Cell proc_make_vector(const Cells & c)
+{
+  if (c.empty() || c.size() > 2 || Index(c[0]) == size_t(-1))
+  {
+    std::cout << "make-vector needs a length\n";
+    exit(1);
+  }
+  return Make(std::make_shared<VectorData>(Index(c[0]), c.size() > 1 ? c[1] : FalseBool));
+}
+
+Cell proc_vector_ref(const Cell & v, const Cell & i)
+{
+  Cell value;
+  if (!Data(v).Get(Index(i), value))
+    OutOfRange(i);
+  return value;
+}
+
+Cell proc_vector_set(const Cell & v, const Cell & i, const Cell & value)
+{
+  if (!Data(v).Set(Index(i), value))
+    OutOfRange(i);
+  return value;
+}
+
+Cell proc_vector_length(const Cell & v)
+{
+  return MakeFixnum(Data(v).Size());
+}
+
+Cell proc_vector_push(const Cell & v, const Cell & value)
+{
+  Data(v).Push(value);
+  return value;
+}
+
+Cell proc_list_to_vector(const Cell & l)
+{
+  return Make(std::make_shared<VectorData>(l.GetList()));
+}
+
+Cell proc_vector_to_list(const Cell & v)
+{
+  Cells data(Data(v).Elements());
+  Cell result(List);
+  ListStore& store(result.MutableList());
+  store.Reserve(data.size());
+  for (size_t i = 0; i < data.size(); ++i)
+    store.PushBack(data[i]);
+  return result;
+}
+
+}
+
+void mu::AddVectorGlobals(Env& env)
+{
+  env["vector"]        = Cell(&proc_vector);
+  env["make-vector"]   = Cell(&proc_make_vector);
+  env["vector-ref"]    = Cell(&proc_vector_ref);
+  env["vector-set!"]   = Cell(&proc_vector_set);
+  env["vector-length"] = Cell(&proc_vector_length);
+  env["vector-push!"]  = Cell(&proc_vector_push);
+  env["list->vector"]  = Cell(&proc_list_to_vector);
+  env["vector->list"]  = Cell(&proc_vector_to_list);
+}
@@ -0,0 +1,50 @@
+#ifndef __MU_CELLVEC_HPP__
+#define __MU_CELLVEC_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// a mutable vector of any Cells, shared by every copy of its Cell:
+// O(1) indexing into one contiguous array, growing geometrically
+class VectorData : public Object
+{
+public:
+  VectorData()
+  {
+  }
+
+  VectorData(size_t n, const Cell& fill)
+  : m_data(n, fill)
+  {
+  }
+
+  explicit VectorData(const Cells& data)
+  : m_data(data)
+  {
+  }
+
+  std::string ToString() const;
+
+  size_t Size() const;
+  // false if i is out of range
+  bool Get(size_t i, Cell& value) const;
+  bool Set(size_t i, const Cell& value);
+  void Push(const Cell& value);
+  // a copy of the elements
+  Cells Elements() const;
+
+private:
+  Cells m_data;
+  mutable std::mutex m_mutex; // held while spawned evaluations may be running
+};
+
+// register (vector x ...), (make-vector n [fill]), (vector-ref v i),
+// (vector-set! v i x), (vector-length v), (vector-push! v x),
+// (list->vector l) and (vector->list v). fill defaults to #f
+void AddVectorGlobals(Env& env);
+
+}
+
+#endif
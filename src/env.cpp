@@ -2,4 +2,6 @@
 
 using namespace mu;
 
+std::atomic<int> Env::s_spawned(0);
 
+std::atomic<uint64_t> Env::s_epoch(0);
@@ -3,6 +3,9 @@
 
 #include "cell.hpp"
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <set>
 
 namespace mu {
 
@@ -25,15 +28,79 @@ public:
     // map a variable name onto a Cell
     typedef std::map<std::string, Cell> map;
 
-    // return a reference to the innermost Env where 'var' appears
-    map & find(const std::string & var)
+    // return a copy of the Cell bound to 'var' in the innermost Env where it appears
+    Cell lookup(const std::string & var)
     {
-        if (m_env.find(var) != m_env.end())
-            return m_env; // the symbol exists in this Env
-        if (m_outer)
-            return m_outer->find(var); // attempt to find the symbol in some "outer" env
-        std::cout << "unbound symbol '" << var << "'\n";
-        exit(1);
+        for (Env* e = this; e; e = e->m_outer) {
+            Lock lock(*e);
+            map::const_iterator i = e->m_env.find(var);
+            if (i != e->m_env.end())
+                return i->second;
+        }
+        unbound(var);
+        return Nil;
+    }
+
+    // like lookup, but an unbound 'var' makes it return false instead
+    bool lookup(const std::string & var, Cell & value)
+    {
+        for (Env* e = this; e; e = e->m_outer) {
+            Lock lock(*e);
+            map::const_iterator i = e->m_env.find(var);
+            if (i != e->m_env.end()) {
+                value = i->second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // rebind 'var' in the innermost Env where it appears (set!)
+    Cell assign(const std::string & var, const Cell & val)
+    {
+        for (Env* e = this; e; e = e->m_outer) {
+            Lock lock(*e);
+            map::iterator i = e->m_env.find(var);
+            if (i != e->m_env.end()) {
+                e->rebound(var);
+                return i->second = val;
+            }
+        }
+        unbound(var);
+        return Nil;
+    }
+
+    // bind 'var' in this Env (define)
+    Cell define(const std::string & var, const Cell & val)
+    {
+        Lock lock(*this);
+        std::pair<map::iterator, bool> i = m_env.insert(map::value_type(var, val));
+        if (i.second)
+            return i.first->second;
+        rebound(var);
+        return i.first->second = val;
+    }
+
+    // whether the global binding of 'var' has been redefined or set!
+    // since it was first defined
+    bool reassigned(const std::string & var)
+    {
+        Lock lock(*this);
+        return m_reassigned.count(var) > 0;
+    }
+
+    // promise that optimized code relies on the current binding of 'var'
+    // in this Env: rebinding it will move the epoch on
+    void seal(const std::string & var)
+    {
+        Lock lock(*this);
+        m_sealed.insert(var);
+    }
+
+    // changes whenever a sealed binding is rebound
+    static uint64_t epoch()
+    {
+        return s_epoch.load(std::memory_order_acquire);
     }
 
     // return a reference to the Cell associated with the given symbol 'var'
@@ -41,10 +108,80 @@ public:
     {
         return m_env[var];
     }
+
+    // number of spawned evaluations in flight; frames are only locked
+    // while it is non-zero so single threaded scripts never touch a mutex
+    static std::atomic<int> s_spawned;
     
 private:
+    // holds the frame's mutex, but only while spawned evaluations may be running
+    class Lock
+    {
+    public:
+      explicit Lock(Env& env)
+      : m_mutex(s_spawned.load(std::memory_order_acquire) ? &env.m_mutex : nullptr)
+      {
+        if (m_mutex)
+          m_mutex->lock();
+      }
+
+      ~Lock()
+      {
+        if (m_mutex)
+          m_mutex->unlock();
+      }
+
+    private:
+      std::mutex* m_mutex;
+    };
+
+    // 'var', already bound here, is being bound again. Code optimized
+    // under the old epoch is never used again, so nothing stays sealed
+    void rebound(const std::string & var)
+    {
+        if (!m_outer)
+            m_reassigned.insert(var);
+        if (!m_sealed.empty() && m_sealed.count(var)) {
+            s_epoch.fetch_add(1, std::memory_order_acq_rel);
+            m_sealed.clear();
+        }
+    }
+
+    static std::atomic<uint64_t> s_epoch;
+
+    static void unbound(const std::string & var)
+    {
+        std::cout << "unbound symbol '" << var << "'\n";
+        exit(1);
+    }
+
     map m_env; // inner symbol->Cell mapping
     Env* m_outer; // next adjacent outer env, or 0 if there are no further Envs
+    std::set<std::string> m_sealed; // bindings optimized code relies on
+    std::set<std::string> m_reassigned; // globals bound more than once
+    std::mutex m_mutex; // guards m_env while spawned evaluations are running
+};
+
+// holds a mutex guarding a shared mutable value (a hash table, a vector),
+// but like Env frames only while spawned evaluations may be running
+class SpawnedLock
+{
+public:
+  explicit SpawnedLock(std::mutex& mutex)
+  : m_mutex(Env::s_spawned.load(std::memory_order_acquire) ? &mutex : nullptr)
+  {
+    if (m_mutex)
+      m_mutex->lock();
+  }
+
+  ~SpawnedLock()
+  {
+    if (m_mutex)
+      m_mutex->unlock();
+  }
+
+private:
+  std::mutex* m_mutex;
 };
 
 }
@@ -0,0 +1,101 @@
+#include "eventloop.hpp"
+#include <iostream>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace mu;
+
+EventLoop::EventLoop()
+: m_epoll(epoll_create1(EPOLL_CLOEXEC)), m_wakeup(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+  if (m_epoll < 0 || m_wakeup < 0)
+  {
+    std::cout << "cannot create event loop\n";
+    exit(1);
+  }
+  epoll_event ev = epoll_event();
+  ev.events = EPOLLIN;
+  ev.data.fd = m_wakeup;
+  epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+}
+
+EventLoop::~EventLoop()
+{
+  close(m_wakeup);
+  close(m_epoll);
+}
+
+void EventLoop::Watch(int fd, uint32_t events, const Handler& handler)
+{
+  epoll_event ev = epoll_event();
+  ev.events = events;
+  ev.data.fd = fd;
+  bool known = m_handlers.count(fd) != 0;
+  m_handlers[fd] = handler;
+  epoll_ctl(m_epoll, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+}
+
+void EventLoop::Unwatch(int fd)
+{
+  if (m_handlers.erase(fd))
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::Post(const std::function<void()>& fn)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_posted.push_back(fn);
+  }
+  uint64_t one = 1;
+  ssize_t n = write(m_wakeup, &one, sizeof(one));
+  (void)n;
+}
+
+void EventLoop::RunPosted()
+{
+  uint64_t count;
+  ssize_t n = read(m_wakeup, &count, sizeof(count));
+  (void)n;
+  std::vector<std::function<void()> > posted;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    posted.swap(m_posted);
+  }
+  for (size_t i = 0; i < posted.size(); ++i)
+    posted[i]();
+}
+
+int EventLoop::Poll(int timeoutMs)
+{
+  epoll_event events[64];
+  int n = epoll_wait(m_epoll, events, 64, timeoutMs);
+  if (n < 0)
+    return errno == EINTR ? 0 : -1;
+  int ran = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    if (events[i].data.fd == m_wakeup)
+    {
+      RunPosted();
+      ++ran;
+      continue;
+    }
+    std::map<int, Handler>::iterator h = m_handlers.find(events[i].data.fd);
+    if (h == m_handlers.end())
+      continue; // unwatched by an earlier handler of this round
+    // copy: the handler may unwatch its own fd
+    Handler handler(h->second);
+    handler(events[i].events);
+    ++ran;
+  }
+  return ran;
+}
+
+EventLoop& EventLoop::Default()
+{
+  static thread_local EventLoop loop;
+  return loop;
+}
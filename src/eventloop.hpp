@@ -0,0 +1,52 @@
+#ifndef __MU_EVENTLOOP_HPP__
+#define __MU_EVENTLOOP_HPP__
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace mu {
+
+// a thin epoll wrapper that drives the completion of asynchronous primitives
+class EventLoop
+{
+public:
+  typedef std::function<void(uint32_t events)> Handler;
+
+  EventLoop();
+  ~EventLoop();
+
+  // call handler each time fd becomes ready for 'events' (EPOLLIN, ...)
+  // until Unwatch(fd); handlers run on the thread calling Poll()
+  void Watch(int fd, uint32_t events, const Handler& handler);
+  void Unwatch(int fd);
+
+  // queue fn to run on the loop's thread; safe to call from any thread,
+  // which is how blocking work done on helper threads reports back
+  void Post(const std::function<void()>& fn);
+
+  // wait up to timeoutMs (-1 forever) for events and dispatch them;
+  // return the number of handlers run
+  int Poll(int timeoutMs);
+
+  // the loop belonging to the calling thread
+  static EventLoop& Default();
+
+private:
+  EventLoop(const EventLoop&);
+  EventLoop& operator=(const EventLoop&);
+
+  void RunPosted();
+
+  int m_epoll;
+  int m_wakeup; // eventfd signalled by Post()
+  std::map<int, Handler> m_handlers;
+  std::mutex m_mutex; // guards m_posted
+  std::vector<std::function<void()> > m_posted;
+};
+
+}
+
+#endif
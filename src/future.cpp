@@ -0,0 +1,21 @@
+#include "future.hpp"
+
+using namespace mu;
+
+void FutureState::Resolve(const Cell& value)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_value = value;
+    m_done = true;
+  }
+  m_cond.notify_all();
+}
+
+Cell FutureState::Touch()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_done)
+    m_cond.wait(lock);
+  return m_value;
+}
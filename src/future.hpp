@@ -0,0 +1,34 @@
+#ifndef __MU_FUTURE_HPP__
+#define __MU_FUTURE_HPP__
+
+#include "cell.hpp"
+#include <mutex>
+#include <condition_variable>
+
+namespace mu {
+
+// the result of a (spawn exp), filled in by the worker thread evaluating exp
+class FutureState : public Object
+{
+public:
+  FutureState()
+  : m_done(false)
+  {
+  }
+
+  // publish the value and wake every thread blocked in Touch()
+  void Resolve(const Cell& value);
+
+  // block until the value is available and return it
+  Cell Touch();
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_done;
+  Cell m_value;
+};
+
+}
+
+#endif
@@ -0,0 +1,312 @@
+#include "hamt.hpp"
+#include "hashtable.hpp"
+#include "number.hpp"
+#include <iostream>
+
+using namespace mu;
+
+namespace {
+
+struct HamtEntry
+{
+  Cell m_key;
+  Cell m_value;
+  uint64_t m_hash;
+};
+
+typedef std::shared_ptr<const HamtEntry> EntryPtr;
+typedef std::shared_ptr<const HamtNode> NodePtr;
+
+const unsigned Bits = 5; // of the hash consumed per level
+
+}
+
+// a trie node: one slot per set bit of m_bitmap, in bit order, each
+// either an entry or a child node. Below the last level of the hash a
+// collision node holds entries whose hashes are all equal, unordered
+// and without a bitmap
+struct mu::HamtNode
+{
+  struct Slot
+  {
+    EntryPtr m_entry;
+    NodePtr m_child;
+  };
+
+  HamtNode()
+  : m_bitmap(0)
+  {
+  }
+
+  uint32_t m_bitmap;
+  std::vector<Slot> m_slots;
+};
+
+namespace {
+
+uint32_t Bit(uint64_t hash, unsigned shift)
+{
+  return uint32_t(1) << ((hash >> shift) & 31);
+}
+
+size_t Index(uint32_t bitmap, uint32_t bit)
+{
+  return __builtin_popcount(bitmap & (bit - 1));
+}
+
+bool Matches(const HamtEntry& entry, uint64_t hash, const Cell& key)
+{
+  return entry.m_hash == hash && SameKey(entry.m_key, key);
+}
+
+const HamtEntry* Find(const HamtNode* node, uint64_t hash, const Cell& key)
+{
+  for (unsigned shift = 0; node; shift += Bits)
+  {
+    if (shift >= 64)
+    {
+      for (size_t i = 0; i < node->m_slots.size(); ++i)
+        if (Matches(*node->m_slots[i].m_entry, hash, key))
+          return node->m_slots[i].m_entry.get();
+      return nullptr;
+    }
+    uint32_t bit = Bit(hash, shift);
+    if (!(node->m_bitmap & bit))
+      return nullptr;
+    const HamtNode::Slot& slot = node->m_slots[Index(node->m_bitmap, bit)];
+    if (slot.m_entry)
+      return Matches(*slot.m_entry, hash, key) ? slot.m_entry.get() : nullptr;
+    node = slot.m_child.get();
+  }
+  return nullptr;
+}
+
+// the smallest subtrie, starting at 'shift', holding two entries
+NodePtr Pair(const EntryPtr& a, const EntryPtr& b, unsigned shift)
+{
+  std::shared_ptr<HamtNode> node(new HamtNode);
+  if (shift >= 64)
+  {
+    node->m_slots.push_back(HamtNode::Slot{a, nullptr});
+    node->m_slots.push_back(HamtNode::Slot{b, nullptr});
+    return node;
+  }
+  uint32_t bitA = Bit(a->m_hash, shift), bitB = Bit(b->m_hash, shift);
+  if (bitA == bitB)
+  {
+    node->m_bitmap = bitA;
+    node->m_slots.push_back(HamtNode::Slot{nullptr, Pair(a, b, shift + Bits)});
+    return node;
+  }
+  node->m_bitmap = bitA | bitB;
+  node->m_slots.push_back(HamtNode::Slot{bitA < bitB ? a : b, nullptr});
+  node->m_slots.push_back(HamtNode::Slot{bitA < bitB ? b : a, nullptr});
+  return node;
+}
+
+NodePtr Insert(const HamtNode& node, const EntryPtr& entry, unsigned shift, bool& added)
+{
+  std::shared_ptr<HamtNode> copy(new HamtNode(node));
+  if (shift >= 64)
+  {
+    for (size_t i = 0; i < copy->m_slots.size(); ++i)
+      if (Matches(*copy->m_slots[i].m_entry, entry->m_hash, entry->m_key))
+      {
+        copy->m_slots[i].m_entry = entry;
+        return copy;
+      }
+    copy->m_slots.push_back(HamtNode::Slot{entry, nullptr});
+    added = true;
+    return copy;
+  }
+
+  uint32_t bit = Bit(entry->m_hash, shift);
+  size_t i = Index(node.m_bitmap, bit);
+  if (!(node.m_bitmap & bit))
+  {
+    copy->m_bitmap |= bit;
+    copy->m_slots.insert(copy->m_slots.begin() + i, HamtNode::Slot{entry, nullptr});
+    added = true;
+    return copy;
+  }
+  HamtNode::Slot& slot = copy->m_slots[i];
+  if (slot.m_child)
+    slot.m_child = Insert(*slot.m_child, entry, shift + Bits, added);
+  else if (Matches(*slot.m_entry, entry->m_hash, entry->m_key))
+    slot.m_entry = entry;
+  else
+  {
+    slot.m_child = Pair(slot.m_entry, entry, shift + Bits);
+    slot.m_entry.reset();
+    added = true;
+  }
+  return copy;
+}
+
+// node without key, or node itself if key is not there. A child left
+// holding a single entry is replaced by the entry, so the trie stays
+// as shallow as it would be had the key never been added
+NodePtr Erase(const NodePtr& node, uint64_t hash, const Cell& key, unsigned shift, bool& removed)
+{
+  size_t i = 0;
+  NodePtr child;
+  if (shift >= 64)
+  {
+    while (i < node->m_slots.size() && !Matches(*node->m_slots[i].m_entry, hash, key))
+      ++i;
+    if (i == node->m_slots.size())
+      return node;
+  }
+  else
+  {
+    uint32_t bit = Bit(hash, shift);
+    if (!(node->m_bitmap & bit))
+      return node;
+    i = Index(node->m_bitmap, bit);
+    const HamtNode::Slot& slot = node->m_slots[i];
+    if (slot.m_child)
+    {
+      child = Erase(slot.m_child, hash, key, shift + Bits, removed);
+      if (!removed)
+        return node;
+    }
+    else if (!Matches(*slot.m_entry, hash, key))
+      return node;
+  }
+  removed = true;
+
+  std::shared_ptr<HamtNode> copy(new HamtNode(*node));
+  if (child && child->m_slots.size() == 1 && child->m_slots[0].m_entry)
+    copy->m_slots[i] = child->m_slots[0];
+  else if (child)
+    copy->m_slots[i].m_child = child;
+  else
+  {
+    if (shift < 64)
+      copy->m_bitmap &= ~Bit(hash, shift);
+    copy->m_slots.erase(copy->m_slots.begin() + i);
+  }
+  if (copy->m_slots.empty())
+    return nullptr;
+  return copy;
+}
+
+}
+
+std::string Hamt::ToString() const
+{
+  return "<PersistentMap>";
+}
+
+bool Hamt::Get(const Cell& key, Cell& value) const
+{
+  const HamtEntry* entry = Find(m_root.get(), HashKey(key), key);
+  if (!entry)
+    return false;
+  value = entry->m_value;
+  return true;
+}
+
+Hamt Hamt::Set(const Cell& key, const Cell& value) const
+{
+  EntryPtr entry(new HamtEntry{key, value, HashKey(key)});
+  if (!m_root)
+  {
+    std::shared_ptr<HamtNode> root(new HamtNode);
+    root->m_bitmap = Bit(entry->m_hash, 0);
+    root->m_slots.push_back(HamtNode::Slot{entry, nullptr});
+    return Hamt(root, 1);
+  }
+  bool added = false;
+  NodePtr root(Insert(*m_root, entry, 0, added));
+  return Hamt(root, m_count + added);
+}
+
+Hamt Hamt::Erase(const Cell& key) const
+{
+  if (!m_root)
+    return *this;
+  bool removed = false;
+  NodePtr root(::Erase(m_root, HashKey(key), key, 0, removed));
+  return removed ? Hamt(root, m_count - 1) : *this;
+}
+
+namespace {
+
+const Hamt& Map(const Cell& c)
+{
+  if (c.GetType() != PersistentMap)
+  {
+    std::cout << "persistent map expected: " << c.ToString() << "\n";
+    exit(1);
+  }
+  return *c.GetObject<Hamt>();
+}
+
+Cell Make(const Hamt& map)
+{
+  return Cell(PersistentMap, std::make_shared<Hamt>(map));
+}
+
+Cell proc_pmap(const Cells & c)
+{
+  if (c.size() % 2)
+  {
+    std::cout << "pmap takes keys and values in pairs\n";
+    exit(1);
+  }
+  Hamt map;
+  for (size_t i = 0; i < c.size(); i += 2)
+    map = map.Set(c[i], c[i + 1]);
+  return Make(map);
+}
+
+Cell proc_pmap_ref3(const Cell & map, const Cell & key, const Cell & fallback)
+{
+  Cell value;
+  return Map(map).Get(key, value) ? value : fallback;
+}
+
+Cell proc_pmap_ref2(const Cell & map, const Cell & key)
+{
+  return proc_pmap_ref3(map, key, FalseBool);
+}
+
+Cell proc_pmap_ref(const Cells & c)
+{
+  if (c.size() != 3)
+  {
+    std::cout << "pmap-ref takes a map, a key and an optional default\n";
+    exit(1);
+  }
+  return proc_pmap_ref3(c[0], c[1], c[2]);
+}
+
+Cell proc_pmap_set(const Cell & map, const Cell & key, const Cell & value)
+{
+  return Make(Map(map).Set(key, value));
+}
+
+Cell proc_pmap_delete(const Cell & map, const Cell & key)
+{
+  const Hamt& m(Map(map));
+  Hamt erased(m.Erase(key));
+  // nothing was removed: the map is returned as it is
+  return erased.Count() == m.Count() ? map : Make(erased);
+}
+
+Cell proc_pmap_count(const Cell & map)
+{
+  return MakeFixnum(Map(map).Count());
+}
+
+}
+
+void mu::AddHamtGlobals(Env& env)
+{
+  env["pmap"]        = Cell(&proc_pmap);
+  env["pmap-ref"]    = Cell(&proc_pmap_ref2, &proc_pmap_ref);
+  env["pmap-set"]    = Cell(&proc_pmap_set);
+  env["pmap-delete"] = Cell(&proc_pmap_delete);
+  env["pmap-count"]  = Cell(&proc_pmap_count);
+}
@@ -0,0 +1,56 @@
+#ifndef __MU_HAMT_HPP__
+#define __MU_HAMT_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+struct HamtNode; // defined in hamt.cpp
+
+// an immutable map, a hash array mapped trie: each level of the trie
+// indexes 5 bits of the key's hash through a 32-bit bitmap, and only
+// the present children are stored. Set and Erase copy the nodes on the
+// path to the key, at most 13 of them, and share everything else with
+// the map they started from. Keys follow HashKey and SameKey.
+class Hamt : public Object
+{
+public:
+  Hamt()
+  : m_count(0)
+  {
+  }
+
+  std::string ToString() const;
+
+  size_t Count() const
+  {
+    return m_count;
+  }
+
+  // the value bound to key, if there is one
+  bool Get(const Cell& key, Cell& value) const;
+  // a map that also binds key to value; this one is left as it was
+  Hamt Set(const Cell& key, const Cell& value) const;
+  // a map without key
+  Hamt Erase(const Cell& key) const;
+
+private:
+  Hamt(const std::shared_ptr<const HamtNode>& root, size_t count)
+  : m_root(root), m_count(count)
+  {
+  }
+
+  std::shared_ptr<const HamtNode> m_root; // nullptr for the empty map
+  size_t m_count;
+};
+
+// register (pmap key value ...), (pmap-ref map key [default]),
+// (pmap-set map key value), (pmap-delete map key) and (pmap-count map).
+// pmap-set and pmap-delete return a new map; pmap-ref returns default,
+// or #f, for a missing key
+void AddHamtGlobals(Env& env);
+
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include "hashcons.hpp"
+#include "hashtable.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace mu;
+
+namespace {
+
+std::atomic<bool> s_enabled(false);
+
+// the interned lists by hash. Entries whose list has died are swept out
+// whenever the table has doubled since the last sweep
+class Table
+{
+public:
+  Table()
+  : m_sweepAt(1024)
+  {
+  }
+
+  Cell Intern(const Cell& c)
+  {
+    const ListStore& store(*c.GetListStore());
+    uint64_t hash;
+    if (!TryHashKey(c, hash))
+      return c; // it holds procedures or other values without a hash
+    std::shared_ptr<Object> found;
+    // released after the lock, in case that frees an expired list
+    std::vector<std::shared_ptr<Object> > held;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto range = m_lists.equal_range(hash);
+    for (auto i = range.first; i != range.second && !found; ++i)
+    {
+      std::shared_ptr<Object> other(i->second.lock());
+      if (other && Equal(*static_cast<ListStore*>(other.get()), store))
+        found = other;
+      held.push_back(other);
+    }
+    if (found)
+      return Cell(List, found);
+
+    c.GetListStore()->SetInterned(hash);
+    m_lists.insert(Lists::value_type(hash, c.GetSharedObject()));
+    if (m_lists.size() >= m_sweepAt)
+      Sweep();
+    return c;
+  }
+
+private:
+  typedef std::unordered_multimap<uint64_t, std::weak_ptr<Object> > Lists;
+
+  static bool Equal(const ListStore& a, const ListStore& b)
+  {
+    if (a.Size() != b.Size())
+      return false;
+    if (a.GetStrategy() == ListStore::Ints && b.GetStrategy() == ListStore::Ints)
+      return a.GetInts() == b.GetInts();
+    for (size_t i = 0; i < a.Size(); ++i)
+      if (!SameKey(a.At(i), b.At(i)))
+        return false;
+    return true;
+  }
+
+  void Sweep()
+  {
+    for (Lists::iterator i = m_lists.begin(); i != m_lists.end();)
+      i = i->second.expired() ? m_lists.erase(i) : ++i;
+    m_sweepAt = std::max<size_t>(1024, m_lists.size() * 2);
+  }
+
+  std::mutex m_mutex;
+  Lists m_lists;
+  size_t m_sweepAt;
+};
+
+Table& Interned()
+{
+  static Table* table = new Table;
+  return *table;
+}
+
+Cell proc_equal(const Cell & a, const Cell & b)
+{
+  if (a.GetType() != b.GetType())
+    return FalseBool;
+  switch (a.GetType())
+  {
+  case Symbol: case String: case Number: case Boolean: case List:
+    return MakeBool(SameKey(a, b));
+  default:
+    // anything else is only equal to itself
+    return MakeBool(a.GetSharedObject() == b.GetSharedObject() && a.GetEnv() == b.GetEnv() &&
+                    a.GetProc() == b.GetProc() && a.GetProc1() == b.GetProc1());
+  }
+}
+
+Cell proc_hash_consing(const Cell & on)
+{
+  bool was = HashConsing();
+  SetHashConsing(on.GetType() != Boolean || on.GetBoolVal());
+  return MakeBool(was);
+}
+
+}
+
+bool mu::HashConsing()
+{
+  return s_enabled.load(std::memory_order_relaxed);
+}
+
+void mu::SetHashConsing(bool on)
+{
+  s_enabled.store(on, std::memory_order_relaxed);
+}
+
+Cell mu::HashCons(const Cell& c)
+{
+  if (!HashConsing() || c.GetType() != List)
+    return c;
+  ListStore* store = c.GetListStore();
+  if (!store || !store->Size())
+    return Cell(List);
+  if (store->IsInterned())
+    return c;
+  return Interned().Intern(c);
+}
+
+void mu::AddHashConsGlobals(Env& env)
+{
+  env["equal?"]       = Cell(&proc_equal);
+  env["hash-consing"] = Cell(&proc_hash_consing);
+}
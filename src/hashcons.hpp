@@ -0,0 +1,29 @@
+#ifndef __MU_HASHCONS_HPP__
+#define __MU_HASHCONS_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// hash-consing, off unless turned on: lists made by the reader (so all
+// quoted data) and by list, cons, append and cdr are looked up in a
+// table of the lists made so far, and a list equal to one still alive
+// shares its store instead of keeping its own. The table only holds
+// weak references, so it does not keep lists alive. Interned stores are
+// never changed in place, which makes equal interned lists the very
+// same store: equal? on them is a pointer comparison.
+bool HashConsing();
+void SetHashConsing(bool on);
+
+// c, or the interned list equal to it when hash-consing is on
+Cell HashCons(const Cell& c);
+
+// register (equal? a b), which compares numbers, symbols, strings,
+// booleans and lists by value, and (hash-consing on) which switches the
+// mode and returns the previous setting
+void AddHashConsGlobals(Env& env);
+
+}
+
+#endif
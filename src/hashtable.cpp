@@ -0,0 +1,320 @@
+#include "hashtable.hpp"
+#include "number.hpp"
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+using namespace mu;
+
+namespace {
+
+// the splitmix64 finalizer: every input bit affects every output bit, so
+// the low bits used to pick a slot are well mixed
+uint64_t Mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+uint64_t HashString(const std::string& s, CellType type)
+{
+  return Mix(std::hash<std::string>()(s) + type);
+}
+
+uint64_t HashNumber(const Cell& c)
+{
+  if (c.IsFixnum())
+    return Mix(uint64_t(c.GetFixnum()));
+  if (c.IsReal())
+  {
+    // 0.0 and -0.0 are the same key, and so are all NaNs
+    double x = c.GetReal() == 0 ? 0.0 : c.GetReal();
+    if (std::isnan(x))
+      x = NAN;
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof bits);
+    return Mix(bits ^ Real);
+  }
+  return HashString(c.GetVal(), Number);
+}
+
+}
+
+bool mu::TryHashKey(const Cell& key, uint64_t& hash)
+{
+  switch (key.GetType())
+  {
+  case Symbol:
+  case String:
+    hash = HashString(key.GetVal(), key.GetType());
+    return true;
+  case Number:
+    hash = HashNumber(key);
+    return true;
+  case Boolean:
+    hash = Mix(key.GetBoolVal() ? 2 : 1);
+    return true;
+  case List:
+  {
+    ListStore* store = key.GetListStore();
+    if (store && store->IsInterned())
+    {
+      hash = store->GetHash();
+      return true;
+    }
+    uint64_t h = Mix(List), element;
+    for (size_t i = 0; i < key.ListSize(); ++i)
+    {
+      if (!TryHashKey(key.ListAt(i), element))
+        return false;
+      h = Mix(h ^ element);
+    }
+    hash = h;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+uint64_t mu::HashKey(const Cell& key)
+{
+  uint64_t hash;
+  if (!TryHashKey(key, hash))
+  {
+    std::cout << "not a valid hash key: " << key.ToString() << "\n";
+    exit(1);
+  }
+  return hash;
+}
+
+bool mu::SameKey(const Cell& a, const Cell& b)
+{
+  if (a.GetType() != b.GetType())
+    return false;
+  switch (a.GetType())
+  {
+  case Number:
+    if (a.IsReal() != b.IsReal())
+      return false;
+    if (a.IsReal())
+      return a.GetReal() == b.GetReal() || (std::isnan(a.GetReal()) && std::isnan(b.GetReal()));
+    if (a.IsFixnum() && b.IsFixnum())
+      return a.GetFixnum() == b.GetFixnum();
+    return NumberCompare(a, b) == 0;
+  case Boolean:
+    return a.GetBoolVal() == b.GetBoolVal();
+  case List:
+  {
+    // equal interned lists share their store
+    ListStore* x = a.GetListStore();
+    ListStore* y = b.GetListStore();
+    if (x == y)
+      return true;
+    if (x && y && x->IsInterned() && y->IsInterned())
+      return false;
+    if (a.ListSize() != b.ListSize())
+      return false;
+    for (size_t i = 0; i < a.ListSize(); ++i)
+      if (!SameKey(a.ListAt(i), b.ListAt(i)))
+        return false;
+    return true;
+  }
+  default:
+    return a.GetVal() == b.GetVal();
+  }
+}
+
+HashTableData::HashTableData(size_t capacity)
+{
+  size_t slots = 8;
+  while (slots < capacity * 2)
+    slots *= 2;
+  m_slots.assign(slots, Slot{0, Vacant});
+  m_entries.reserve(capacity);
+}
+
+std::string HashTableData::ToString() const
+{
+  return "<HashTable>";
+}
+
+size_t HashTableData::Find(const Cell& key, uint64_t hash) const
+{
+  size_t mask = m_slots.size() - 1;
+  uint32_t tag = uint32_t(hash >> 32);
+  for (size_t i = hash & mask;; i = (i + 1) & mask)
+  {
+    const Slot& slot = m_slots[i];
+    if (slot.m_entry == Vacant)
+      return i;
+    if (slot.m_tag == tag && SameKey(m_entries[slot.m_entry].m_key, key))
+      return i;
+  }
+}
+
+void HashTableData::Rehash(size_t slots)
+{
+  m_slots.assign(slots, Slot{0, Vacant});
+  size_t mask = slots - 1;
+  for (uint32_t e = 0; e < m_entries.size(); ++e)
+  {
+    uint64_t hash = m_entries[e].m_hash;
+    size_t i = hash & mask;
+    while (m_slots[i].m_entry != Vacant)
+      i = (i + 1) & mask;
+    m_slots[i] = Slot{uint32_t(hash >> 32), e};
+  }
+}
+
+bool HashTableData::Get(const Cell& key, Cell& value) const
+{
+  uint64_t hash = HashKey(key);
+  SpawnedLock lock(m_mutex);
+  const Slot& slot = m_slots[Find(key, hash)];
+  if (slot.m_entry == Vacant)
+    return false;
+  value = m_entries[slot.m_entry].m_value;
+  return true;
+}
+
+void HashTableData::Set(const Cell& key, const Cell& value)
+{
+  uint64_t hash = HashKey(key);
+  SpawnedLock lock(m_mutex);
+  size_t i = Find(key, hash);
+  if (m_slots[i].m_entry != Vacant)
+  {
+    m_entries[m_slots[i].m_entry].m_value = value;
+    return;
+  }
+  if ((m_entries.size() + 1) * 2 > m_slots.size())
+  {
+    Rehash(m_slots.size() * 2);
+    i = Find(key, hash);
+  }
+  m_slots[i] = Slot{uint32_t(hash >> 32), uint32_t(m_entries.size())};
+  m_entries.push_back(Entry{key, value, hash});
+}
+
+bool HashTableData::Erase(const Cell& key)
+{
+  uint64_t hash = HashKey(key);
+  SpawnedLock lock(m_mutex);
+  size_t mask = m_slots.size() - 1;
+  size_t i = Find(key, hash);
+  uint32_t erased = m_slots[i].m_entry;
+  if (erased == Vacant)
+    return false;
+
+  // shift later members of the probe run back into the hole, so lookups
+  // never need tombstones
+  for (size_t j = (i + 1) & mask; m_slots[j].m_entry != Vacant; j = (j + 1) & mask)
+  {
+    size_t home = m_entries[m_slots[j].m_entry].m_hash & mask;
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      m_slots[i] = m_slots[j];
+      i = j;
+    }
+  }
+  m_slots[i].m_entry = Vacant;
+
+  // keep the entries dense by moving the last one into the gap
+  uint32_t last = uint32_t(m_entries.size() - 1);
+  if (erased != last)
+  {
+    size_t k = m_entries[last].m_hash & mask;
+    while (m_slots[k].m_entry != last)
+      k = (k + 1) & mask;
+    m_slots[k].m_entry = erased;
+    m_entries[erased] = m_entries[last];
+  }
+  m_entries.pop_back();
+  return true;
+}
+
+size_t HashTableData::Count() const
+{
+  SpawnedLock lock(m_mutex);
+  return m_entries.size();
+}
+
+namespace {
+
+HashTableData& Table(const Cell& c)
+{
+  if (c.GetType() != HashTable)
+  {
+    std::cout << "hash table expected: " << c.ToString() << "\n";
+    exit(1);
+  }
+  return *c.GetObject<HashTableData>();
+}
+
+Cell proc_make_hash_table(const Cells & c)
+{
+  size_t capacity = 0;
+  if (!c.empty())
+  {
+    if (c[0].GetType() != Number || !c[0].IsFixnum() || c[0].GetFixnum() < 0)
+    {
+      std::cout << "make-hash-table needs a capacity: " << c[0].ToString() << "\n";
+      exit(1);
+    }
+    capacity = size_t(c[0].GetFixnum());
+  }
+  return Cell(HashTable, std::make_shared<HashTableData>(capacity));
+}
+
+Cell proc_hash_ref3(const Cell & table, const Cell & key, const Cell & fallback)
+{
+  Cell value;
+  return Table(table).Get(key, value) ? value : fallback;
+}
+
+Cell proc_hash_ref2(const Cell & table, const Cell & key)
+{
+  return proc_hash_ref3(table, key, FalseBool);
+}
+
+Cell proc_hash_ref(const Cells & c)
+{
+  if (c.size() != 3)
+  {
+    std::cout << "hash-ref takes a table, a key and an optional default\n";
+    exit(1);
+  }
+  return proc_hash_ref3(c[0], c[1], c[2]);
+}
+
+Cell proc_hash_set(const Cell & table, const Cell & key, const Cell & value)
+{
+  Table(table).Set(key, value);
+  return value;
+}
+
+Cell proc_hash_delete(const Cell & table, const Cell & key)
+{
+  return MakeBool(Table(table).Erase(key));
+}
+
+Cell proc_hash_count(const Cell & table)
+{
+  return MakeFixnum(Table(table).Count());
+}
+
+}
+
+void mu::AddHashTableGlobals(Env& env)
+{
+  env["make-hash-table"] = Cell(&proc_make_hash_table);
+  env["hash-ref"]        = Cell(&proc_hash_ref2, &proc_hash_ref);
+  env["hash-set!"]       = Cell(&proc_hash_set);
+  env["hash-delete!"]    = Cell(&proc_hash_delete);
+  env["hash-count"]      = Cell(&proc_hash_count);
+}
@@ -0,0 +1,71 @@
+#ifndef __MU_HASHTABLE_HPP__
+#define __MU_HASHTABLE_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// the hash of a Cell used as a key. symbols, strings, numbers, booleans
+// and lists of them are hashable; anything else is an error
+uint64_t HashKey(const Cell& key);
+
+// like HashKey, but returns false for a key that cannot be hashed
+bool TryHashKey(const Cell& key, uint64_t& hash);
+
+// whether a and b are the same key: same type and same value, where
+// numbers are only the same if they are both exact or both reals
+bool SameKey(const Cell& a, const Cell& b);
+
+// a mutable hash table shared by every copy of its Cell. the entries
+// live densely in one vector; the table itself is an open addressed
+// array of 8-byte slots, each holding the upper half of an entry's hash
+// and its index, probed linearly so a lookup usually touches one cache
+// line before it compares a single key
+class HashTableData : public Object
+{
+public:
+  explicit HashTableData(size_t capacity = 0);
+
+  std::string ToString() const;
+
+  // the value bound to key, if there is one
+  bool Get(const Cell& key, Cell& value) const;
+  void Set(const Cell& key, const Cell& value);
+  // false if key was not there
+  bool Erase(const Cell& key);
+  size_t Count() const;
+
+private:
+  static const uint32_t Vacant = uint32_t(-1);
+
+  struct Slot
+  {
+    uint32_t m_tag;   // the upper 32 bits of the entry's hash
+    uint32_t m_entry; // index into m_entries, or Vacant
+  };
+
+  struct Entry
+  {
+    Cell m_key;
+    Cell m_value;
+    uint64_t m_hash;
+  };
+
+  // the slot holding key, or the vacant slot where it would go
+  size_t Find(const Cell& key, uint64_t hash) const;
+  void Rehash(size_t slots);
+
+  std::vector<Slot> m_slots; // a power of two in size, at most half full
+  std::vector<Entry> m_entries;
+  mutable std::mutex m_mutex; // held while spawned evaluations may be running
+};
+
+// register (make-hash-table [capacity]), (hash-ref table key [default]),
+// (hash-set! table key value), (hash-delete! table key) and
+// (hash-count table). hash-ref returns default, or #f, for a missing key
+void AddHashTableGlobals(Env& env);
+
+}
+
+#endif
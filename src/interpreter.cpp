@@ -1,112 +1,658 @@
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <list>
 #include <map>
+#include <thread>
+#include <fstream>
 #include <ctype.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include "catch.hpp"
 #include "cell.hpp"
 #include "env.hpp"
+#include "future.hpp"
+#include "number.hpp"
+#include "numvec.hpp"
+#include "pending.hpp"
+#include "promise.hpp"
+#include "sort.hpp"
+#include "vmap.hpp"
+#include "hashtable.hpp"
+#include "hamt.hpp"
+#include "cellvec.hpp"
+#include "rope.hpp"
+#include "record.hpp"
+#include "hashcons.hpp"
+#include "optimize.hpp"
 #include "interpreter.hpp"
 
 using namespace mu;
 
-// return given mumber as a string
-std::string str(long n) { std::ostringstream os; os << n; return os.str(); }
-
 // return true iff given character is '0'..'9'
 bool isdig(char c) { return isdigit(static_cast<unsigned char>(c)) != 0; }
 
 
 Cell proc_add(const Cells & c)
 {
-    long n(atol(c[0].GetVal().c_str()));
-    for (Cellit i = c.begin()+1; i != c.end(); ++i) n += atol(i->GetVal().c_str());
-    return Cell(Number, str(n));
+    Cell n(c[0]);
+    for (Cellit i = c.begin()+1; i != c.end(); ++i) n = NumberAdd(n, *i);
+    return n;
 }
 
 Cell proc_sub(const Cells & c)
 {
-    long n(atol(c[0].GetVal().c_str()));
-    for (Cellit i = c.begin()+1; i != c.end(); ++i) n -= atol(i->GetVal().c_str());
-    return Cell(Number, str(n));
+    Cell n(c[0]);
+    for (Cellit i = c.begin()+1; i != c.end(); ++i) n = NumberSub(n, *i);
+    return n;
 }
 
 Cell proc_mul(const Cells & c)
 {
-    long n(1);
-    for (Cellit i = c.begin(); i != c.end(); ++i) n *= atol(i->GetVal().c_str());
-    return Cell(Number, str(n));
+    Cell n(MakeFixnum(1));
+    for (Cellit i = c.begin(); i != c.end(); ++i) n = NumberMul(n, *i);
+    return n;
 }
 
 Cell proc_div(const Cells & c)
 {
-    long n(atol(c[0].GetVal().c_str()));
-    for (Cellit i = c.begin()+1; i != c.end(); ++i) n /= atol(i->GetVal().c_str());
-    return Cell(Number, str(n));
+    Cell n(c[0]);
+    for (Cellit i = c.begin()+1; i != c.end(); ++i) n = NumberDiv(n, *i);
+    return n;
 }
 
 Cell proc_greater(const Cells & c)
 {
-    long n(atol(c[0].GetVal().c_str()));
     for (Cellit i = c.begin()+1; i != c.end(); ++i)
-        if (n <= atol(i->GetVal().c_str()))
+        if (NumberCompare(c[0], *i) <= 0)
             return FalseBool;
     return TrueBool;
 }
 
 Cell proc_less(const Cells & c)
 {
-    long n(atol(c[0].GetVal().c_str()));
     for (Cellit i = c.begin()+1; i != c.end(); ++i)
-        if (n >= atol(i->GetVal().c_str()))
+        if (NumberCompare(c[0], *i) >= 0)
             return FalseBool;
     return TrueBool;
 }
 
 Cell proc_less_equal(const Cells & c)
 {
-    long n(atol(c[0].GetVal().c_str()));
     for (Cellit i = c.begin()+1; i != c.end(); ++i)
-        if (n > atol(i->GetVal().c_str()))
+        if (NumberCompare(c[0], *i) > 0)
             return FalseBool;
     return TrueBool;
 }
 
-Cell proc_length(const Cells & c) { return Cell(Number, str(c[0].GetList().size())); }
-Cell proc_nullp(const Cells & c)  { return c[0].GetList().empty() ? TrueBool : FalseBool; }
-Cell proc_car(const Cells & c)    { return c[0].GetList()[0]; }
+// two argument entries of the arithmetic and comparison primitives,
+// used by eval for the common binary call instead of the variadic ones
+Cell proc_add2(const Cell & a, const Cell & b) { return NumberAdd(a, b); }
+Cell proc_sub2(const Cell & a, const Cell & b) { return NumberSub(a, b); }
+Cell proc_mul2(const Cell & a, const Cell & b) { return NumberMul(a, b); }
+Cell proc_div2(const Cell & a, const Cell & b) { return NumberDiv(a, b); }
+Cell proc_greater2(const Cell & a, const Cell & b)    { return NumberCompare(a, b) > 0 ? TrueBool : FalseBool; }
+Cell proc_less2(const Cell & a, const Cell & b)       { return NumberCompare(a, b) < 0 ? TrueBool : FalseBool; }
+Cell proc_less_equal2(const Cell & a, const Cell & b) { return NumberCompare(a, b) <= 0 ? TrueBool : FalseBool; }
+
+Cell proc_length(const Cell & l) { return MakeFixnum(l.ListSize()); }
+Cell proc_nullp(const Cell & l)  { return l.ListSize() == 0 ? TrueBool : FalseBool; }
 
-Cell proc_cdr(const Cells & c)
+Cell proc_car(const Cell & l)
 {
-  if (c[0].GetList().size() < 2)
+  if (l.ListSize() == 0)
+  {
+    std::cout << "car of an empty list\n";
+    exit(1);
+  }
+  return l.ListAt(0);
+}
+
+Cell proc_cdr(const Cell & l)
+{
+  if (l.ListSize() < 2)
     return Nil;
-  Cell result(c[0]);
-  result.GetList().erase(result.GetList().begin());
+  return HashCons(Cell(List, l.GetListStore()->Slice(1, l.ListSize())));
+}
+
+Cell proc_append(const Cell & a, const Cell & b)
+{
+  Cell result(List);
+  if (a.GetListStore())
+    result = Cell(List, std::make_shared<ListStore>(*a.GetListStore()));
+  if (b.GetListStore())
+    result.MutableList().Append(*b.GetListStore());
+  return HashCons(result);
+}
+
+Cell proc_cons(const Cell & a, const Cell & b)
+{
+  Cell result(List);
+  ListStore& store(result.MutableList());
+  store.PushBack(a);
+  if (b.GetListStore())
+    store.Append(*b.GetListStore());
+  return HashCons(result);
+}
+
+Cell proc_list(const Cells & c)
+{
+  Cell result(List);
+  for (Cellit i = c.begin(); i != c.end(); ++i) result.PushBack(*i);
+  return HashCons(result);
+}
+
+// (touch f) waits for the future f; any other value is returned as is
+Cell proc_touch(const Cell & f)
+{
+  if (f.GetType() != Future)
+    return f;
+  return f.GetObject<FutureState>()->Touch();
+}
+
+// (sleep ms) completes after ms milliseconds; inside a Task only the
+// calling task waits, on a timerfd watched by the thread's EventLoop
+Cell proc_sleep(const Cell & c)
+{
+  long ms(c.GetFixnum());
+  itimerspec spec = itimerspec();
+  spec.it_value.tv_sec = ms / 1000;
+  spec.it_value.tv_nsec = ms > 0 ? (ms % 1000) * 1000000 : 1; // zero would disarm the timer
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  timerfd_settime(fd, 0, &spec, nullptr);
+  std::shared_ptr<PendingState> pending(new PendingState);
+  EventLoop & loop = EventLoop::Default();
+  loop.Watch(fd, EPOLLIN, [&loop, fd, pending](uint32_t) {
+    loop.Unwatch(fd);
+    close(fd);
+    pending->Complete(Nil);
+  });
+  return Cell(Pending, pending);
+}
+
+// (read-file path) returns the file's contents as a string, or #f if it
+// cannot be read; the read happens on a helper thread which posts the
+// result back to the calling thread's EventLoop
+Cell proc_read_file(const Cell & c)
+{
+  std::shared_ptr<PendingState> pending(new PendingState);
+  EventLoop & loop = EventLoop::Default();
+  std::string path(c.GetVal());
+  std::thread([&loop, path, pending]() {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::ostringstream data;
+    bool ok = in && (data << in.rdbuf());
+    std::string contents(data.str());
+    loop.Post([pending, ok, contents]() {
+      pending->Complete(ok ? Cell(String, contents) : FalseBool);
+    });
+  }).detach();
+  return Cell(Pending, pending);
+}
+
+////////////////////// higher-order primitives
+
+Cell eval(Cell x, Env * env);
+
+// true if evaluating x could keep a reference to the frame it runs in
+bool captures_frame(const Cell & x)
+{
+  if (x.GetType() == Symbol)
+    return x.GetVal() == "lambda" || x.GetVal() == "define" || x.GetVal() == "spawn" ||
+           x.GetVal() == "delay" || x.GetVal() == "stream-cons" || x.GetVal() == "define-record-type";
+  if (x.GetType() == Guarded)
+    return captures_frame(x.GetObject<GuardedExpr>()->GetFast()) ||
+           captures_frame(x.GetObject<GuardedExpr>()->GetOriginal());
+  if (x.GetType() != List)
+    return false;
+  for (Cellit i = x.GetList().begin(); i != x.GetList().end(); ++i)
+    if (captures_frame(*i))
+      return true;
+  return false;
+}
+
+// calls one procedure many times with 'argc' arguments. A Lambda whose
+// body cannot capture its frame runs every call in the same frame with
+// the parameters rebound, instead of allocating an Env per call.
+class Caller
+{
+public:
+  Caller(const Cell & proc, size_t argc)
+  : m_proc(proc), m_frame(proc.GetType() == Lambda ? proc.GetEnv() : nullptr), m_reuse(false), m_active(false), m_args(argc)
+  {
+    if (proc.GetType() != Lambda)
+      return;
+    const Cells & params = proc.GetList()[1].GetList();
+    if (params.size() != argc) {
+      std::cout << "wrong number of arguments\n";
+      exit(1);
+    }
+    m_body = proc.GetList()[2];
+    m_reuse = !captures_frame(m_body);
+    for (Cellit p = params.begin(); p != params.end(); ++p)
+      m_slots.push_back(&m_frame[p->GetVal()]);
+  }
+
+  // the argument vector the next Call() passes
+  Cells & Args() { return m_args; }
+
+  Cell Call()
+  {
+    // a call made while the frame is in use gets a frame of its own
+    if (!m_reuse || m_active)
+      return mu::Apply(m_proc, m_args);
+    for (size_t i = 0; i < m_slots.size(); ++i)
+      *m_slots[i] = m_args[i];
+    m_active = true;
+    Cell result(eval(m_body, &m_frame));
+    m_active = false;
+    return result;
+  }
+
+  Cell operator()(const Cell & a)
+  {
+    m_args[0] = a;
+    return Call();
+  }
+
+  Cell operator()(const Cell & a, const Cell & b)
+  {
+    m_args[0] = a;
+    m_args[1] = b;
+    return Call();
+  }
+
+private:
+  Cell m_proc;
+  Cell m_body;
+  Env m_frame;
+  bool m_reuse;
+  bool m_active;
+  Cells m_args;
+  std::vector<Cell *> m_slots;
+};
+
+// anything but #f counts as true
+bool truthy(const Cell & c) { return c.GetType() != Boolean || c.GetBoolVal(); }
+
+// the length of the shortest of the lists c[first..]
+size_t shortest(const Cells & c, size_t first)
+{
+  if (c.size() <= first) {
+    std::cout << "wrong number of arguments\n";
+    exit(1);
+  }
+  size_t n = c[first].ListSize();
+  for (size_t i = first + 1; i < c.size(); ++i)
+    n = std::min(n, c[i].ListSize());
+  return n;
+}
+
+// (map f list ...) the list of (f x ...) for the elements of the lists, up
+// to the shortest
+Cell proc_map(const Cells & c)
+{
+  Caller call(c[0], c.size() - 1);
+  size_t n = shortest(c, 1);
+  Cell result(List);
+  ListStore & store(result.MutableList());
+  store.Reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t k = 1; k < c.size(); ++k)
+      call.Args()[k - 1] = c[k].ListAt(i);
+    store.PushBack(call.Call());
+  }
   return result;
 }
 
-Cell proc_append(const Cells & c)
+// (for-each f list ...) like map, for the side effects only
+Cell proc_for_each(const Cells & c)
+{
+  Caller call(c[0], c.size() - 1);
+  size_t n = shortest(c, 1);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t k = 1; k < c.size(); ++k)
+      call.Args()[k - 1] = c[k].ListAt(i);
+    call.Call();
+  }
+  return Nil;
+}
+
+// (filter pred list) the elements for which pred is not #f
+Cell proc_filter(const Cell & pred, const Cell & l)
 {
+  Caller call(pred, 1);
   Cell result(List);
-  result.GetList() = c[0].GetList();
-  for (Cellit i = c[1].GetList().begin(); i != c[1].GetList().end(); ++i) result.GetList().push_back(*i);
+  ListStore & store(result.MutableList());
+  for (size_t i = 0; i < l.ListSize(); ++i) {
+    Cell x(l.ListAt(i));
+    if (truthy(call(x)))
+      store.PushBack(x);
+  }
   return result;
 }
 
-Cell proc_cons(const Cells & c)
+// (fold kons knil list) (kons xn ... (kons x2 (kons x1 knil))), left to right
+Cell proc_fold(const Cell & kons, const Cell & knil, const Cell & l)
+{
+  Caller call(kons, 2);
+  Cell acc(knil);
+  for (size_t i = 0; i < l.ListSize(); ++i)
+    acc = call(l.ListAt(i), acc);
+  return acc;
+}
+
+// (apply f arg ... list) calls f with the args followed by the list's elements
+Cell proc_apply(const Cells & c)
+{
+  if (c.size() < 2) {
+    std::cout << "wrong number of arguments\n";
+    exit(1);
+  }
+  const Cell & last = c.back();
+  Cells args(c.begin() + 1, c.end() - 1);
+  args.reserve(args.size() + last.ListSize());
+  for (size_t i = 0; i < last.ListSize(); ++i)
+    args.push_back(last.ListAt(i));
+  return mu::Apply(c[0], args);
+}
+
+////////////////////// list pipelines
+
+// what a call to one of the list primitives does to its last argument
+enum PipeKind { Pipe_None, Pipe_Map, Pipe_Filter, Pipe_Fold, Pipe_ForEach };
+
+// the role of a call to proc with 'argc' arguments, when it is one of the
+// single list map, filter, fold or for-each primitives
+PipeKind pipe_kind(const Cell & proc, size_t argc)
+{
+  if (proc.GetType() != Proc)
+    return Pipe_None;
+  if (proc.GetProc() == &proc_map && proc.GetArity() < 0 && argc == 2)
+    return Pipe_Map;
+  if (proc.GetProc() == &proc_for_each && proc.GetArity() < 0 && argc == 2)
+    return Pipe_ForEach;
+  if (proc.GetArity() == 2 && proc.GetProc2() == &proc_filter && argc == 2)
+    return Pipe_Filter;
+  if (proc.GetArity() == 3 && proc.GetProc3() == &proc_fold && argc == 3)
+    return Pipe_Fold;
+  return Pipe_None;
+}
+
+bool special_form(const Cell & x)
+{
+  static const char * forms[] = { "quote", "if", "set!", "define", "lambda", "begin", "spawn",
+                                  "delay", "stream-cons", "define-record-type" };
+  for (size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); ++i)
+    if (x.GetVal() == forms[i])
+      return true;
+  return false;
+}
+
+bool mu::IsSpecialForm(const std::string & name)
+{
+  return special_form(Cell(Symbol, name));
+}
+
+// the code that stands for x now, if the optimizer rewrote it
+Cell current(const Cell & x)
+{
+  return x.GetType() == Guarded ? x.GetObject<GuardedExpr>()->Current() : x;
+}
+
+// the procedure a call's head refers to, without evaluating anything:
+// a global name or an optimized reference to one
+bool head_proc(const Cell & head, Env * env, Cell & proc)
 {
+  Cell x(current(head));
+  if (Quoted(x, proc))
+    return true;
+  return x.GetType() == Symbol && !special_form(x) && env->lookup(x.GetVal(), proc);
+}
+
+// the kind of stage x is when it is the list argument of a pipeline:
+// a (map f list) or (filter p list) call
+PipeKind stage_kind(const Cell & x, Env * env)
+{
+  Cell stage(current(x));
+  if (stage.GetType() != List || stage.ListSize() != 3)
+    return Pipe_None;
+  Cell proc;
+  if (!head_proc(stage.ListAt(0), env, proc))
+    return Pipe_None;
+  PipeKind kind = pipe_kind(proc, 2);
+  return kind == Pipe_Map || kind == Pipe_Filter ? kind : Pipe_None;
+}
+
+// Runs (map f (filter p (map g list))) and the like, where proc is the
+// outermost primitive and xs the call, as one loop that takes each element
+// through every stage, so only the final result is allocated. Arguments
+// are evaluated in the order eval would use; the stages' calls are made
+// element by element rather than stage by stage. Returns false, having
+// evaluated nothing, if xs is not such a pipeline.
+bool fuse_pipeline(const Cell & proc, const Cells & xs, Env * env, Cell & result)
+{
+  PipeKind sink = pipe_kind(proc, xs.size() - 1);
+  if (sink == Pipe_None || stage_kind(xs.back(), env) == Pipe_None)
+    return false;
+
+  Cell fn(eval(xs[1], env));
+  Cell acc(sink == Pipe_Fold ? eval(xs[2], env) : Nil);
+  // outermost first
+  std::vector<PipeKind> kinds;
+  Cells fns;
+  Cell source(xs.back());
+  for (PipeKind k; (k = stage_kind(source, env)) != Pipe_None;) {
+    Cell stage(current(source));
+    kinds.push_back(k);
+    fns.push_back(eval(stage.ListAt(1), env));
+    source = stage.ListAt(2);
+  }
+  Cell list(eval(source, env));
+
+  std::vector<std::unique_ptr<Caller> > stages;
+  for (size_t i = fns.size(); i-- > 0;)
+    stages.push_back(std::unique_ptr<Caller>(new Caller(fns[i], 1)));
+  Caller sinkCall(fn, sink == Pipe_Fold ? 2 : 1);
+  Cell out(List);
+  ListStore & store(out.MutableList());
+  for (size_t i = 0; i < list.ListSize(); ++i) {
+    Cell v(list.ListAt(i));
+    bool keep = true;
+    for (size_t s = 0; keep && s < stages.size(); ++s) {
+      if (kinds[kinds.size() - 1 - s] == Pipe_Map)
+        v = (*stages[s])(v);
+      else
+        keep = truthy((*stages[s])(v));
+    }
+    if (!keep)
+      continue;
+    if (sink == Pipe_Map)
+      store.PushBack(sinkCall(v));
+    else if (sink == Pipe_Filter) {
+      if (truthy(sinkCall(v)))
+        store.PushBack(v);
+    }
+    else if (sink == Pipe_Fold)
+      acc = sinkCall(v, acc);
+    else
+      sinkCall(v);
+  }
+  result = sink == Pipe_Fold ? acc : sink == Pipe_ForEach ? Nil : out;
+  return true;
+}
+
+////////////////////// promises and streams
+
+// (force p) the value of promise p, evaluating it the first time; any
+// other value is returned as it is
+Cell proc_force(const Cell & c)
+{
+  if (c.GetType() != Promise)
+    return c;
+  PromiseState * p = c.GetObject<PromiseState>();
+  if (!p->IsForced()) {
+    std::function<Cell()> thunk(p->TakeThunk());
+    p->Resolve(thunk ? thunk() : eval(p->GetExpr(), p->GetEnv()));
+  }
+  return p->GetValue();
+}
+
+// A stream is the empty list, or a list of its first element and a
+// stream for the rest, or a promise of either. The rest is typically a
+// promise, so elements are only computed as they are reached. The stream
+// primitives keep no reference to the part of a stream they have walked
+// past, so a pipeline whose head is not held anywhere runs in constant
+// memory however far it goes.
+
+Cell stream_pair(const Cell & first, const Cell & rest)
+{
+  Cell pair(List);
+  pair.PushBack(first);
+  pair.PushBack(rest);
+  return pair;
+}
+
+Cell proc_stream_car(const Cell & s)
+{
+  Cell pair(proc_force(s));
+  if (pair.ListSize() != 2) {
+    std::cout << "stream-car of an empty stream\n";
+    exit(1);
+  }
+  return pair.ListAt(0);
+}
+
+Cell proc_stream_cdr(const Cell & s)
+{
+  Cell pair(proc_force(s));
+  if (pair.ListSize() != 2) {
+    std::cout << "stream-cdr of an empty stream\n";
+    exit(1);
+  }
+  return pair.ListAt(1);
+}
+
+Cell proc_stream_nullp(const Cell & s) { return proc_force(s).ListSize() == 0 ? TrueBool : FalseBool; }
+
+Cell lazy(const std::function<Cell()> & thunk) { return Cell(Promise, std::make_shared<PromiseState>(thunk)); }
+
+Cell stream_map(const std::shared_ptr<Caller> & f, const Cell & s)
+{
+  Cell rest(s);
+  return lazy([f, rest]() mutable -> Cell {
+    Cell pair(proc_force(rest));
+    rest = Nil; // let go of the element we are at
+    if (pair.ListSize() == 0)
+      return pair;
+    return stream_pair((*f)(pair.ListAt(0)), stream_map(f, pair.ListAt(1)));
+  });
+}
+
+// (stream-map f s) the stream of (f x) for the elements x of s
+Cell proc_stream_map(const Cell & f, const Cell & s)
+{
+  return stream_map(std::make_shared<Caller>(f, 1), s);
+}
+
+Cell stream_filter(const std::shared_ptr<Caller> & pred, const Cell & s)
+{
+  Cell rest(s);
+  return lazy([pred, rest]() mutable -> Cell {
+    Cell pair(proc_force(rest));
+    rest = Nil;
+    while (pair.ListSize() != 0 && !truthy((*pred)(pair.ListAt(0))))
+      pair = proc_force(pair.ListAt(1));
+    if (pair.ListSize() == 0)
+      return pair;
+    return stream_pair(pair.ListAt(0), stream_filter(pred, pair.ListAt(1)));
+  });
+}
+
+// (stream-filter pred s) the stream of the elements of s for which pred is
+// not #f
+Cell proc_stream_filter(const Cell & pred, const Cell & s)
+{
+  return stream_filter(std::make_shared<Caller>(pred, 1), s);
+}
+
+// (stream-take n s) a list of the first n elements of s, or all of them
+// if s is shorter
+Cell proc_stream_take(const Cell & n, const Cell & s)
+{
+  if (n.GetType() != Number || !n.IsFixnum() || n.GetFixnum() < 0) {
+    std::cout << "stream-take needs a count: " << n.ToString() << "\n";
+    exit(1);
+  }
   Cell result(List);
-  result.GetList().push_back(c[0]);
-  for (Cellit i = c[1].GetList().begin(); i != c[1].GetList().end(); ++i) result.GetList().push_back(*i);
+  Cell pair(proc_force(s));
+  for (int64_t i = 0; i < n.GetFixnum() && pair.ListSize() != 0; ++i) {
+    result.PushBack(pair.ListAt(0));
+    if (i + 1 < n.GetFixnum())
+      pair = proc_force(pair.ListAt(1));
+  }
   return result;
 }
 
-Cell proc_list(const Cells & c)
+////////////////////// sort
+
+bool is_nan(const Cell & c) { return c.IsReal() && c.GetReal() != c.GetReal(); }
+
+// (sort list less?) a new list of the elements of list, ordered by less?.
+// With the builtin < or > the numbers are compared directly, on several
+// threads for long lists, and NaNs, which are neither less nor greater
+// than anything, go last. Any other less? is called through a Caller and
+// gives a stable sort.
+Cell proc_sort(const Cell & l, const Cell & less)
 {
-  Cell result(List); result.GetList() = c;
+  int order = 0; // 1 for the builtin <, -1 for the builtin >
+  if (less.GetType() == Proc && less.GetArity() == 2)
+    order = less.GetProc2() == &proc_less2 ? 1 : less.GetProc2() == &proc_greater2 ? -1 : 0;
+  const ListStore * store = l.GetListStore();
+  if (!store)
+    return Cell(List);
+
+  if (order && store->GetStrategy() == ListStore::Ints) {
+    std::vector<int64_t> v(store->GetInts());
+    if (order > 0)
+      ParallelSort(v.data(), v.data() + v.size(), std::less<int64_t>());
+    else
+      ParallelSort(v.data(), v.data() + v.size(), std::greater<int64_t>());
+    return Cell(List, std::make_shared<ListStore>(v));
+  }
+  if (order && store->GetStrategy() == ListStore::Reals) {
+    std::vector<double> v(store->GetReals());
+    double * end = v.data() + (std::stable_partition(v.begin(), v.end(), [](double x) { return x == x; }) - v.begin());
+    if (order > 0)
+      ParallelSort(v.data(), end, std::less<double>());
+    else
+      ParallelSort(v.data(), end, std::greater<double>());
+    return Cell(List, std::make_shared<ListStore>(v));
+  }
+
+  Cells v(l.GetList());
+  if (order) {
+    for (Cellit i = v.begin(); i != v.end(); ++i)
+      if (i->GetType() != Number) {
+        std::cout << "not a number: " << i->ToString() << "\n";
+        exit(1);
+      }
+    Cell * end = v.data() + (std::stable_partition(v.begin(), v.end(), [](const Cell & c) { return !is_nan(c); }) - v.begin());
+    ParallelSort(v.data(), end, [order](const Cell & a, const Cell & b) { return NumberCompare(a, b) * order < 0; });
+  }
+  else {
+    Caller call(less, 2);
+    std::stable_sort(v.begin(), v.end(), [&call](const Cell & a, const Cell & b) { return truthy(call(a, b)); });
+  }
+  Cell result(List);
+  ListStore & sorted(result.MutableList());
+  sorted.Reserve(v.size());
+  for (Cellit i = v.begin(); i != v.end(); ++i)
+    sorted.PushBack(*i);
   return result;
 }
 
@@ -118,19 +664,58 @@ void add_globals(Env & env)
     env["append"] = Cell(&proc_append);   env["car"]  = Cell(&proc_car);
     env["cdr"]    = Cell(&proc_cdr);      env["cons"] = Cell(&proc_cons);
     env["length"] = Cell(&proc_length);   env["list"] = Cell(&proc_list);
-    env["null?"]  = Cell(&proc_nullp);    env["+"]    = Cell(&proc_add);
-    env["-"]      = Cell(&proc_sub);      env["*"]    = Cell(&proc_mul);
-    env["/"]      = Cell(&proc_div);      env[">"]    = Cell(&proc_greater);
-    env["<"]      = Cell(&proc_less);     env["<="]   = Cell(&proc_less_equal);
+    env["null?"]  = Cell(&proc_nullp);
+    env["+"]      = Cell(&proc_add2, &proc_add);   env["-"]  = Cell(&proc_sub2, &proc_sub);
+    env["*"]      = Cell(&proc_mul2, &proc_mul);   env["/"]  = Cell(&proc_div2, &proc_div);
+    env[">"]      = Cell(&proc_greater2, &proc_greater);
+    env["<"]      = Cell(&proc_less2, &proc_less);
+    env["<="]     = Cell(&proc_less_equal2, &proc_less_equal);
+    env["touch"]  = Cell(&proc_touch);     env["sleep"] = Cell(&proc_sleep);
+    env["read-file"] = Cell(&proc_read_file);
+    env["map"]    = Cell(&proc_map);       env["for-each"] = Cell(&proc_for_each);
+    env["filter"] = Cell(&proc_filter);    env["fold"]  = Cell(&proc_fold);
+    env["apply"]  = Cell(&proc_apply);
+    env["sort"]   = Cell(&proc_sort);
+    env["force"]  = Cell(&proc_force);     env["stream-nil"] = Cell(List);
+    env["stream-car"]   = Cell(&proc_stream_car);    env["stream-cdr"]    = Cell(&proc_stream_cdr);
+    env["stream-null?"] = Cell(&proc_stream_nullp);  env["stream-map"]    = Cell(&proc_stream_map);
+    env["stream-filter"] = Cell(&proc_stream_filter); env["stream-take"]  = Cell(&proc_stream_take);
+    AddNumVecGlobals(env);
+    AddVmapGlobals(env);
+    AddHashTableGlobals(env);
+    AddHamtGlobals(env);
+    AddVectorGlobals(env);
+    AddRopeGlobals(env);
+    AddHashConsGlobals(env);
+    RecordPrimitives(env);
 }
 
 
 ////////////////////// eval
 
+// start evaluating x on a worker thread and return a Future for its value.
+// The worker gets a frame of its own whose outer Env is the current one,
+// so defines made by x stay private while lookups see the captured scope.
+Cell spawn(const Cell & x, Env * env)
+{
+  std::shared_ptr<FutureState> future(new FutureState);
+  Env * frame = new Env(env);
+  ++Env::s_spawned;
+  std::thread([future, x, frame]() {
+    Cell value(eval(x, frame));
+    --Env::s_spawned;
+    future->Resolve(value);
+  }).detach();
+  return Cell(Future, future);
+}
+
 Cell eval(Cell x, Env * env)
 {
+  if (x.GetType() == Guarded)
+    return eval(x.GetObject<GuardedExpr>()->Current(), env);
+  Task::Tick();
   if (x.GetType() == Symbol)
-    return env->find(x.GetVal())[x.GetVal()];
+    return env->lookup(x.GetVal());
   if (x.GetType() == Number)
     return x;
   if (x.GetType() == String)
@@ -146,9 +731,9 @@ Cell eval(Cell x, Env * env)
     if (x.GetList()[0].GetVal() == "if")          // (if test conseq [alt])
       return eval(! eval(x.GetList()[1], env).GetBoolVal() ? (x.GetList().size() < 4 ? Nil : x.GetList()[3]) : x.GetList()[2], env);
     if (x.GetList()[0].GetVal() == "set!")        // (set! var exp)
-      return env->find(x.GetList()[1].GetVal())[x.GetList()[1].GetVal()] = eval(x.GetList()[2], env);
+      return env->assign(x.GetList()[1].GetVal(), eval(x.GetList()[2], env));
     if (x.GetList()[0].GetVal() == "define")      // (define var exp)
-      return (*env)[x.GetList()[1].GetVal()] = eval(x.GetList()[2], env);
+      return env->define(x.GetList()[1].GetVal(), eval(x.GetList()[2], env));
     if (x.GetList()[0].GetVal() == "lambda") {    // (lambda (var*) exp)
       x.SetType(Lambda);
       // keep a reference to the Env that exists now (when the
@@ -162,12 +747,51 @@ Cell eval(Cell x, Env * env)
         eval(x.GetList()[i], env);
       return eval(x.GetList()[x.GetList().size() - 1], env);
     }
+    if (x.GetList()[0].GetVal() == "spawn")       // (spawn exp)
+      return spawn(x.GetList()[1], env);
+    if (x.GetList()[0].GetVal() == "delay")       // (delay exp)
+      return Cell(Promise, std::make_shared<PromiseState>(x.GetList()[1], env));
+    if (x.GetList()[0].GetVal() == "stream-cons") // (stream-cons first rest)
+      return stream_pair(eval(x.GetList()[1], env), Cell(Promise, std::make_shared<PromiseState>(x.GetList()[2], env)));
+    if (x.GetList()[0].GetVal() == "define-record-type") // (define-record-type name (ctor field*) pred spec*)
+      return DefineRecordType(x.GetList(), env);
   }
   // (proc exp*)
   Cell proc(eval(x.GetList()[0], env));
+  const Cells & xs = x.GetList();
+  Cell fused;
+  if (fuse_pipeline(proc, xs, env, fused))
+    return fused;
+  if (proc.GetType() == Proc && proc.GetArity() == int(xs.size() - 1)) {
+    // fixed arity primitive: pass the evaluated arguments directly
+    Cell result;
+    if (proc.GetArity() == 1) {
+      Cell a(eval(xs[1], env));
+      result = proc.GetProc1()(a);
+    }
+    else if (proc.GetArity() == 2) {
+      Cell a(eval(xs[1], env));
+      Cell b(eval(xs[2], env));
+      result = proc.GetProc2()(a, b);
+    }
+    else {
+      Cell a(eval(xs[1], env));
+      Cell b(eval(xs[2], env));
+      Cell c(eval(xs[3], env));
+      result = proc.GetProc3()(a, b, c);
+    }
+    if (result.GetType() == Pending)
+      return result.GetObject<PendingState>()->Wait(EventLoop::Default());
+    return result;
+  }
   Cells exps;
-  for (Cell::iter exp = x.GetList().begin() + 1; exp != x.GetList().end(); ++exp)
+  for (Cell::iter exp = xs.begin() + 1; exp != xs.end(); ++exp)
     exps.push_back(eval(*exp, env));
+  return mu::Apply(proc, exps);
+}
+
+Cell mu::Apply(const Cell & proc, const Cells & exps)
+{
   if (proc.GetType() == Lambda) {
     // Create an Env for the execution of this lambda function
     // where the outer Env is the one that existed* at the time
@@ -178,8 +802,25 @@ Cell eval(Cell x, Env * env)
     // more symbols defined in that Env.
     return eval(/*body*/proc.GetList()[2], new Env(/*parms*/proc.GetList()[1].GetList(), /*args*/exps, proc.GetEnv()));
   }
-  else if (proc.GetType() == Proc)
-    return proc.GetProc()(exps);
+  else if (proc.GetType() == Proc) {
+    Cell result;
+    if (proc.GetArity() >= 0 && proc.GetArity() == int(exps.size()))
+      result = proc.GetArity() == 1 ? proc.GetProc1()(exps[0]) :
+               proc.GetArity() == 2 ? proc.GetProc2()(exps[0], exps[1]) :
+                                      proc.GetProc3()(exps[0], exps[1], exps[2]);
+    else if (proc.GetProc())
+      result = proc.GetProc()(exps);
+    else if (proc.GetArity() < 0)
+      result = proc.GetObject<NativeProc>()->Call(exps);
+    else {
+      std::cout << "wrong number of arguments\n";
+      exit(1);
+    }
+    // an asynchronous primitive: wait for it without blocking other tasks
+    if (result.GetType() == Pending)
+      return result.GetObject<PendingState>()->Wait(EventLoop::Default());
+    return result;
+  }
 
   std::cout << "not a function\n";
   exit(1);
@@ -269,19 +910,19 @@ Tokens Tokenize(const std::string& str)
 // return the Lisp expression in the given tokens
 Cell ReadFrom(Tokens& tokens)
 {
-  const Token token(tokens.front());
+  const Token token(std::move(tokens.front()));
   tokens.erase(tokens.begin());
   if (token.m_kind == TokenKind_Par && token.m_token == "(") {
     Cell c(List);
     while (tokens.front().m_kind != TokenKind_Par || tokens.front().m_token != ")")
-      c.GetList().push_back(ReadFrom(tokens));
+      c.PushBack(ReadFrom(tokens));
     tokens.erase(tokens.begin());
-    return c;
+    return HashCons(c);
   }
   else if (token.m_kind == TokenKind_Number)
     return Cell(Number, token.m_token);
   else if (token.m_kind == TokenKind_String)
-    return Cell(String, token.m_token);
+    return InternString(token.m_token);
   else
   {
     if (token.m_token == "#f")
@@ -309,7 +950,7 @@ void repl(const std::string & prompt, Env * env)
         std::cout << prompt;
         std::string line; 
         std::getline(std::cin, line);
-        std::cout << eval(read(line), env).ToString() << '\n';
+        std::cout << eval(Optimize(read(line), *env), env).ToString() << '\n';
     }
 }
 
@@ -320,7 +961,30 @@ Interpreter::Interpreter()
 
 Cell Interpreter::Eval(const std::string& str)
 {
-  return eval(read(str), &m_env);
+  return eval(Optimize(read(str), m_env), &m_env);
+}
+
+void Interpreter::Define(const std::string& name, Cell::ProcType proc)
+{
+  m_env.define(name, Cell(proc));
+}
+
+void Interpreter::Define(const std::string& name, const Cell& value)
+{
+  m_env.define(name, value);
+}
+
+void Interpreter::Define(const std::string& name, const Signature& signature, const NativeProc::Function& fn)
+{
+  Cell proc(Proc, std::make_shared<NativeProc>(name, signature, fn));
+  m_env.define(name, proc);
+}
+
+std::shared_ptr<Task> Interpreter::Start(const std::string& str, size_t budget)
+{
+  Cell x(Optimize(read(str), m_env));
+  Env * frame = new Env(&m_env);
+  return std::make_shared<Task>([x, frame]() { return eval(x, frame); }, budget);
 }
 
 void Interpreter::Repl()
@@ -3,6 +3,9 @@
 
 #include "cell.hpp"
 #include "env.hpp"
+#include "native.hpp"
+#include "task.hpp"
+#include <memory>
 
 namespace mu {
 
@@ -12,12 +15,37 @@ public:
   Interpreter();
 
   Cell Eval(const std::string& str);
+
+  // bind 'name' in the global Env to a stateless primitive; calls go
+  // straight through the function pointer, exactly like the built-ins
+  void Define(const std::string& name, Cell::ProcType proc);
+
+  // bind 'name' in the global Env to any value, e.g. a fixed arity
+  // primitive Cell(&proc3) or Cell(&proc2, &variadicFallback)
+  void Define(const std::string& name, const Cell& value);
+
+  // bind 'name' in the global Env to a host function carrying its own
+  // context; each call is checked against 'signature' first
+  void Define(const std::string& name, const Signature& signature, const NativeProc::Function& fn);
+
+  // parse str and return a Task that evaluates it in a frame of its own
+  // (defines stay private to the task, globals are shared) yielding back
+  // to its caller after every 'budget' eval steps
+  std::shared_ptr<Task> Start(const std::string& str, size_t budget = 1000);
+
   void Repl();
 
 private:
   Env m_env;
 };
 
+// call a Lambda or primitive with arguments that are already evaluated
+Cell Apply(const Cell& proc, const Cells& args);
+
+// whether a list headed by the symbol 'name' is a special form, such as
+// if or lambda, rather than a call
+bool IsSpecialForm(const std::string& name);
+
 }
 
 #endif
@@ -0,0 +1,20 @@
+#include "native.hpp"
+#include <iostream>
+
+using namespace mu;
+
+Cell NativeProc::Call(const Cells& args) const
+{
+  if (args.size() < m_signature.m_minArgs || args.size() > m_signature.m_maxArgs)
+  {
+    std::cout << "wrong number of arguments to '" << m_name << "'\n";
+    exit(1);
+  }
+  for (size_t i = 0; i < m_signature.m_types.size() && i < args.size(); ++i)
+    if (args[i].GetType() != m_signature.m_types[i])
+    {
+      std::cout << "wrong type of argument " << i + 1 << " to '" << m_name << "'\n";
+      exit(1);
+    }
+  return m_fn(args);
+}
@@ -0,0 +1,64 @@
+#ifndef __MU_NATIVE_HPP__
+#define __MU_NATIVE_HPP__
+
+#include "cell.hpp"
+#include <functional>
+#include <initializer_list>
+
+namespace mu {
+
+// the arguments a host function accepts: an arity range and optionally
+// the CellType of each leading argument
+struct Signature
+{
+  static const size_t Unbounded = size_t(-1);
+
+  // exactly 'arity' arguments of any type
+  Signature(size_t arity)
+  : m_minArgs(arity), m_maxArgs(arity)
+  {
+  }
+
+  // exactly these argument types
+  Signature(std::initializer_list<CellType> types)
+  : m_minArgs(types.size()), m_maxArgs(types.size()), m_types(types)
+  {
+  }
+
+  // 'minArgs' or more arguments of any type
+  static Signature Variadic(size_t minArgs = 0)
+  {
+    Signature s(minArgs);
+    s.m_maxArgs = Unbounded;
+    return s;
+  }
+
+  size_t m_minArgs;
+  size_t m_maxArgs;
+  std::vector<CellType> m_types;
+};
+
+// a host function that carries state: any callable (a lambda with
+// captures, a functor, a std::bind expression) plus its Signature,
+// which is checked before every call
+class NativeProc : public Object
+{
+public:
+  typedef std::function<Cell(const Cells&)> Function;
+
+  NativeProc(const std::string& name, const Signature& signature, const Function& fn)
+  : m_name(name), m_signature(signature), m_fn(fn)
+  {
+  }
+
+  Cell Call(const Cells& args) const;
+
+private:
+  std::string m_name;
+  Signature m_signature;
+  Function m_fn;
+};
+
+}
+
+#endif
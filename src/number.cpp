@@ -0,0 +1,261 @@
+#include "number.hpp"
+#include <iostream>
+#include <cmath>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace mu;
+
+namespace {
+
+void CheckNumber(const Cell& c)
+{
+  if (c.GetType() != Number)
+  {
+    std::cout << "not a number: " << c.ToString() << "\n";
+    exit(1);
+  }
+}
+
+BigInt ToBigInt(const Cell& c)
+{
+  return c.IsFixnum() ? BigInt(c.GetFixnum()) : *c.GetObject<BigInt>();
+}
+
+// every power of ten up to 10^22 is exactly representable as a double
+const double ExactPowersOfTen[] =
+{
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+}
+
+bool mu::ParseFixnum(const std::string& s, int64_t& n)
+{
+  size_t i = 0;
+  bool negative = false;
+  if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+    negative = s[i++] == '-';
+  if (i == s.size() || s.size() - i > 18)
+    return false; // leave anything that might overflow to BigInt::Parse
+  int64_t r = 0;
+  for (; i < s.size(); ++i)
+  {
+    if (s[i] < '0' || s[i] > '9')
+      return false;
+    r = r * 10 + (s[i] - '0');
+  }
+  n = negative ? -r : r;
+  return true;
+}
+
+bool mu::ParseReal(const char* begin, const char* end, double& x)
+{
+  const char* p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  // up to 19 significant digits fit in the significand; count the rest
+  // only to keep the exponent right
+  uint64_t significand = 0;
+  int digits = 0, exponent = 0;
+  bool any = false, truncated = false;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p, any = true)
+  {
+    if (digits < 19)
+    {
+      significand = significand * 10 + (*p - '0');
+      digits += significand != 0;
+    }
+    else
+    {
+      ++exponent;
+      truncated = truncated || *p != '0';
+    }
+  }
+  if (p != end && *p == '.')
+    for (++p; p != end && *p >= '0' && *p <= '9'; ++p, any = true)
+    {
+      if (digits < 19)
+      {
+        significand = significand * 10 + (*p - '0');
+        digits += significand != 0;
+        --exponent;
+      }
+      else
+        truncated = truncated || *p != '0';
+    }
+  if (!any)
+    return false;
+  if (p != end && (*p == 'e' || *p == 'E'))
+  {
+    ++p;
+    bool negativeExp = false;
+    if (p != end && (*p == '-' || *p == '+'))
+      negativeExp = *p++ == '-';
+    if (p == end)
+      return false;
+    int e = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p)
+      if (e < 100000)
+        e = e * 10 + (*p - '0');
+    exponent += negativeExp ? -e : e;
+  }
+  if (p != end)
+    return false;
+
+  if (significand == 0 && !truncated)
+  {
+    x = negative ? -0.0 : 0.0;
+    return true;
+  }
+  // Clinger's fast path: an exact significand times or divided by an
+  // exact power of ten is correctly rounded by a single IEEE operation
+  const uint64_t maxExact = uint64_t(1) << 53;
+  if (!truncated && significand <= maxExact && exponent >= -22 && exponent <= 22 + 15)
+  {
+    double m = double(significand);
+    int e = exponent;
+    if (e > 22)
+    {
+      // move the excess into the significand while it stays exact
+      for (; e > 22 && significand * 10 <= maxExact; --e)
+        significand *= 10;
+      m = double(significand);
+    }
+    if (e <= 22)
+    {
+      x = e < 0 ? m / ExactPowersOfTen[-e] : m * ExactPowersOfTen[e];
+      x = negative ? -x : x;
+      return true;
+    }
+  }
+  std::string text(begin, end);
+  x = strtod(text.c_str(), nullptr);
+  return true;
+}
+
+std::string mu::FormatReal(double x)
+{
+  if (std::isnan(x))
+    return "+nan.0";
+  if (std::isinf(x))
+    return x < 0 ? "-inf.0" : "+inf.0";
+  if (x == std::trunc(x) && std::fabs(x) < 1e15)
+    return (std::signbit(x) && x == 0 ? "-" : "") + std::to_string(int64_t(x)) + ".0";
+  // the first precision that reads back exactly is the shortest: every
+  // double is exact in 17 digits and, unless subnormal, carries enough
+  // bits for any 15 digit decimal to survive
+  char buf[32];
+  for (int precision = std::fabs(x) < DBL_MIN ? 1 : 15; precision <= 17; ++precision)
+  {
+    snprintf(buf, sizeof(buf), "%.*g", precision, x);
+    double y;
+    if (ParseReal(buf, buf + strlen(buf), y) && y == x)
+      break;
+  }
+  // tidy the exponent the way the reader writes it: e+159 -> e159, e-05 -> e-5
+  std::string s(buf);
+  size_t e = s.find('e');
+  if (e == std::string::npos)
+    return s.find('.') == std::string::npos ? s + ".0" : s;
+  std::string r(s, 0, e + 1);
+  size_t i = e + 1;
+  if (s[i] == '-')
+    r += '-';
+  if (s[i] == '-' || s[i] == '+')
+    ++i;
+  while (i + 1 < s.size() && s[i] == '0')
+    ++i;
+  return r + s.substr(i);
+}
+
+double mu::NumberToDouble(const Cell& c)
+{
+  CheckNumber(c);
+  if (c.IsReal())
+    return c.GetReal();
+  if (c.IsFixnum())
+    return double(c.GetFixnum());
+  return c.GetObject<BigInt>()->ToDouble();
+}
+
+Cell mu::MakeInteger(const BigInt& n)
+{
+  int64_t fixnum;
+  if (n.ToInt64(fixnum))
+    return MakeFixnum(fixnum);
+  return Cell(Number, std::make_shared<BigInt>(n));
+}
+
+Cell mu::NumberAdd(const Cell& a, const Cell& b)
+{
+  CheckNumber(a);
+  CheckNumber(b);
+  if (a.IsReal() || b.IsReal())
+    return MakeReal(NumberToDouble(a) + NumberToDouble(b));
+  int64_t r;
+  if (a.IsFixnum() && b.IsFixnum() && !__builtin_add_overflow(a.GetFixnum(), b.GetFixnum(), &r))
+    return MakeFixnum(r);
+  return MakeInteger(ToBigInt(a) + ToBigInt(b));
+}
+
+Cell mu::NumberSub(const Cell& a, const Cell& b)
+{
+  CheckNumber(a);
+  CheckNumber(b);
+  if (a.IsReal() || b.IsReal())
+    return MakeReal(NumberToDouble(a) - NumberToDouble(b));
+  int64_t r;
+  if (a.IsFixnum() && b.IsFixnum() && !__builtin_sub_overflow(a.GetFixnum(), b.GetFixnum(), &r))
+    return MakeFixnum(r);
+  return MakeInteger(ToBigInt(a) - ToBigInt(b));
+}
+
+Cell mu::NumberMul(const Cell& a, const Cell& b)
+{
+  CheckNumber(a);
+  CheckNumber(b);
+  if (a.IsReal() || b.IsReal())
+    return MakeReal(NumberToDouble(a) * NumberToDouble(b));
+  int64_t r;
+  if (a.IsFixnum() && b.IsFixnum() && !__builtin_mul_overflow(a.GetFixnum(), b.GetFixnum(), &r))
+    return MakeFixnum(r);
+  return MakeInteger(ToBigInt(a) * ToBigInt(b));
+}
+
+Cell mu::NumberDiv(const Cell& a, const Cell& b)
+{
+  CheckNumber(a);
+  CheckNumber(b);
+  if (a.IsReal() || b.IsReal())
+    return MakeReal(NumberToDouble(a) / NumberToDouble(b));
+  if (b.IsFixnum() && b.GetFixnum() == 0)
+  {
+    std::cout << "division by zero\n";
+    exit(1);
+  }
+  // INT64_MIN / -1 is the one fixnum quotient that overflows
+  if (a.IsFixnum() && b.IsFixnum() && !(a.GetFixnum() == INT64_MIN && b.GetFixnum() == -1))
+    return MakeFixnum(a.GetFixnum() / b.GetFixnum());
+  BigInt q, r;
+  BigInt::DivMod(ToBigInt(a), ToBigInt(b), q, r);
+  return MakeInteger(q);
+}
+
+int mu::NumberCompare(const Cell& a, const Cell& b)
+{
+  CheckNumber(a);
+  CheckNumber(b);
+  if (a.IsReal() || b.IsReal())
+  {
+    double x = NumberToDouble(a), y = NumberToDouble(b);
+    return x < y ? -1 : x > y;
+  }
+  if (a.IsFixnum() && b.IsFixnum())
+    return a.GetFixnum() < b.GetFixnum() ? -1 : a.GetFixnum() > b.GetFixnum();
+  return BigInt::Compare(ToBigInt(a), ToBigInt(b));
+}
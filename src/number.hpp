@@ -0,0 +1,55 @@
+#ifndef __MU_NUMBER_HPP__
+#define __MU_NUMBER_HPP__
+
+#include "cell.hpp"
+#include "bigint.hpp"
+
+namespace mu {
+
+inline Cell MakeFixnum(int64_t n)
+{
+  Cell c(Number);
+  c.SetFixnum(n);
+  return c;
+}
+
+inline Cell MakeReal(double x)
+{
+  Cell c(Number);
+  c.SetReal(x);
+  return c;
+}
+
+// a Number holding n, as a fixnum whenever it fits
+Cell MakeInteger(const BigInt& n);
+
+// the value of any Number as the nearest double
+double NumberToDouble(const Cell& c);
+
+// parse an optionally signed decimal integer that fits in 64 bits
+bool ParseFixnum(const std::string& s, int64_t& n);
+
+// parse a decimal real ([-+]digits[.digits][e[-+]digits]) spanning
+// exactly [begin, end), correctly rounded. Literals whose significand
+// and power of ten are both exactly representable (nearly all real world
+// data) take Clinger's fast path; the rest fall back to strtod.
+bool ParseReal(const char* begin, const char* end, double& x);
+
+// the shortest decimal text that reads back as exactly x, always with
+// a '.' or an exponent so that it reads back as a real
+std::string FormatReal(double x);
+
+// integer arithmetic is exact: fixnums are combined with overflow checks
+// and promoted to BigInts only when the result does not fit. If either
+// operand is a real the operation is done in double precision.
+Cell NumberAdd(const Cell& a, const Cell& b);
+Cell NumberSub(const Cell& a, const Cell& b);
+Cell NumberMul(const Cell& a, const Cell& b);
+Cell NumberDiv(const Cell& a, const Cell& b); // truncating for integers
+
+// -1, 0 or 1 as a is less than, equal to or greater than b
+int NumberCompare(const Cell& a, const Cell& b);
+
+}
+
+#endif
@@ -0,0 +1,300 @@
+#include "numvec.hpp"
+#include "number.hpp"
+#include "simd.hpp"
+#include <iostream>
+
+using namespace mu;
+
+namespace {
+
+// what differs between the two element types
+template <class T> struct Packed;
+
+template <> struct Packed<double>
+{
+  static const CellType Type = F64Vector;
+  static const char* Name() { return "f64vector"; }
+  static double FromCell(const Cell& c) { return NumberToDouble(c); }
+  static Cell ToCell(double x) { return MakeReal(x); }
+  static const std::vector<double>* Unboxed(const ListStore& l)
+  {
+    return l.GetStrategy() == ListStore::Reals ? &l.GetReals() : nullptr;
+  }
+  static void Add(const double* a, const double* b, double* out, size_t n) { simd::AddF64(a, b, out, n); }
+  static void Mul(const double* a, const double* b, double* out, size_t n) { simd::MulF64(a, b, out, n); }
+  static void Scale(const double* a, double k, double* out, size_t n)      { simd::ScaleF64(a, k, out, n); }
+  static double Min(const double* a, size_t n)                             { return simd::MinF64(a, n); }
+  static double Max(const double* a, size_t n)                             { return simd::MaxF64(a, n); }
+  static Cell Sum(const double* a, size_t n)                               { return MakeReal(simd::SumF64(a, n)); }
+  static Cell Dot(const double* a, const double* b, size_t n)              { return MakeReal(simd::DotF64(a, b, n)); }
+};
+
+// the largest magnitude in a, saturated to INT64_MAX
+uint64_t Magnitude(const int64_t* a, size_t n)
+{
+  if (!n)
+    return 0;
+  int64_t lo = simd::MinS64(a, n), hi = simd::MaxS64(a, n);
+  uint64_t l = lo == INT64_MIN ? uint64_t(INT64_MAX) : uint64_t(lo < 0 ? -lo : lo);
+  uint64_t h = uint64_t(hi < 0 ? -hi : hi);
+  return l > h ? l : h;
+}
+
+template <> struct Packed<int64_t>
+{
+  static const CellType Type = S64Vector;
+  static const char* Name() { return "s64vector"; }
+  static int64_t FromCell(const Cell& c)
+  {
+    if (c.GetType() != Number || !c.IsFixnum())
+    {
+      std::cout << "s64vector elements must be fixnums: " << c.ToString() << "\n";
+      exit(1);
+    }
+    return c.GetFixnum();
+  }
+  static Cell ToCell(int64_t x) { return MakeFixnum(x); }
+  static const std::vector<int64_t>* Unboxed(const ListStore& l)
+  {
+    return l.GetStrategy() == ListStore::Ints ? &l.GetInts() : nullptr;
+  }
+  static void Add(const int64_t* a, const int64_t* b, int64_t* out, size_t n) { simd::AddS64(a, b, out, n); }
+  static void Mul(const int64_t* a, const int64_t* b, int64_t* out, size_t n) { simd::MulS64(a, b, out, n); }
+  static void Scale(const int64_t* a, int64_t k, int64_t* out, size_t n)      { simd::ScaleS64(a, k, out, n); }
+  static int64_t Min(const int64_t* a, size_t n)                              { return simd::MinS64(a, n); }
+  static int64_t Max(const int64_t* a, size_t n)                              { return simd::MaxS64(a, n); }
+
+  // the SIMD kernels wrap, so they are only used when the bound on the
+  // magnitudes proves that no partial result can overflow
+  static Cell Sum(const int64_t* a, size_t n)
+  {
+    uint64_t bound;
+    if (!__builtin_mul_overflow(Magnitude(a, n), uint64_t(n), &bound) && bound <= uint64_t(INT64_MAX))
+      return MakeFixnum(simd::SumS64(a, n));
+    Cell r(MakeFixnum(0));
+    for (size_t i = 0; i < n; ++i)
+      r = NumberAdd(r, MakeFixnum(a[i]));
+    return r;
+  }
+
+  static Cell Dot(const int64_t* a, const int64_t* b, size_t n)
+  {
+    uint64_t product, bound;
+    if (!__builtin_mul_overflow(Magnitude(a, n), Magnitude(b, n), &product) &&
+        !__builtin_mul_overflow(product, uint64_t(n), &bound) && bound <= uint64_t(INT64_MAX))
+      return MakeFixnum(simd::DotS64(a, b, n));
+    Cell r(MakeFixnum(0));
+    for (size_t i = 0; i < n; ++i)
+      r = NumberAdd(r, NumberMul(MakeFixnum(a[i]), MakeFixnum(b[i])));
+    return r;
+  }
+};
+
+template <class T>
+const std::vector<T>& Data(const Cell& v)
+{
+  if (v.GetType() != Packed<T>::Type)
+  {
+    std::cout << Packed<T>::Name() << " expected: " << v.ToString() << "\n";
+    exit(1);
+  }
+  return v.GetObject<PackedVector<T> >()->m_data;
+}
+
+template <class T>
+Cell Make(std::shared_ptr<PackedVector<T> > data)
+{
+  return Cell(Packed<T>::Type, data);
+}
+
+template <class T>
+void CheckSameLength(const std::vector<T>& a, const std::vector<T>& b)
+{
+  if (a.size() != b.size())
+  {
+    std::cout << Packed<T>::Name() << " lengths differ\n";
+    exit(1);
+  }
+}
+
+size_t Index(const Cell& i, size_t size)
+{
+  if (i.GetType() != Number || !i.IsFixnum() || i.GetFixnum() < 0 || uint64_t(i.GetFixnum()) >= size)
+  {
+    std::cout << "index out of range: " << i.ToString() << "\n";
+    exit(1);
+  }
+  return size_t(i.GetFixnum());
+}
+
+template <class T>
+Cell proc_vec(const Cells & c)
+{
+  std::shared_ptr<PackedVector<T> > v(new PackedVector<T>(c.size()));
+  for (size_t i = 0; i < c.size(); ++i)
+    v->m_data[i] = Packed<T>::FromCell(c[i]);
+  return Make<T>(v);
+}
+
+template <class T>
+Cell proc_make_vec(const Cells & c)
+{
+  if (c.empty() || c[0].GetType() != Number || !c[0].IsFixnum() || c[0].GetFixnum() < 0)
+  {
+    std::cout << "make-" << Packed<T>::Name() << " needs a length\n";
+    exit(1);
+  }
+  T fill = c.size() > 1 ? Packed<T>::FromCell(c[1]) : T();
+  return Make<T>(std::make_shared<PackedVector<T> >(size_t(c[0].GetFixnum()), fill));
+}
+
+template <class T>
+Cell proc_list_to_vec(const Cell & l)
+{
+  // an unboxed list of the right element type is copied as it is
+  const std::vector<T>* unboxed = l.GetListStore() ? Packed<T>::Unboxed(*l.GetListStore()) : nullptr;
+  if (unboxed)
+  {
+    std::shared_ptr<PackedVector<T> > v(new PackedVector<T>(0));
+    v->m_data = *unboxed;
+    return Make<T>(v);
+  }
+  return proc_vec<T>(l.GetList());
+}
+
+template <class T>
+Cell proc_vec_to_list(const Cell & v)
+{
+  const std::vector<T>& data = Data<T>(v);
+  Cell result(List);
+  ListStore& store(result.MutableList());
+  store.Reserve(data.size());
+  for (size_t i = 0; i < data.size(); ++i)
+    store.PushBack(Packed<T>::ToCell(data[i]));
+  return result;
+}
+
+template <class T>
+Cell proc_vec_length(const Cell & v)
+{
+  return MakeFixnum(Data<T>(v).size());
+}
+
+template <class T>
+Cell proc_vec_ref(const Cell & v, const Cell & i)
+{
+  const std::vector<T>& data = Data<T>(v);
+  return Packed<T>::ToCell(data[Index(i, data.size())]);
+}
+
+template <class T>
+Cell proc_vec_add(const Cell & a, const Cell & b)
+{
+  const std::vector<T>& x = Data<T>(a);
+  const std::vector<T>& y = Data<T>(b);
+  CheckSameLength(x, y);
+  std::shared_ptr<PackedVector<T> > r(new PackedVector<T>(x.size()));
+  Packed<T>::Add(x.data(), y.data(), r->m_data.data(), x.size());
+  return Make<T>(r);
+}
+
+template <class T>
+Cell proc_vec_mul(const Cell & a, const Cell & b)
+{
+  const std::vector<T>& x = Data<T>(a);
+  const std::vector<T>& y = Data<T>(b);
+  CheckSameLength(x, y);
+  std::shared_ptr<PackedVector<T> > r(new PackedVector<T>(x.size()));
+  Packed<T>::Mul(x.data(), y.data(), r->m_data.data(), x.size());
+  return Make<T>(r);
+}
+
+template <class T>
+Cell proc_vec_scale(const Cell & a, const Cell & k)
+{
+  const std::vector<T>& x = Data<T>(a);
+  std::shared_ptr<PackedVector<T> > r(new PackedVector<T>(x.size()));
+  Packed<T>::Scale(x.data(), Packed<T>::FromCell(k), r->m_data.data(), x.size());
+  return Make<T>(r);
+}
+
+template <class T>
+Cell proc_vec_dot(const Cell & a, const Cell & b)
+{
+  const std::vector<T>& x = Data<T>(a);
+  const std::vector<T>& y = Data<T>(b);
+  CheckSameLength(x, y);
+  return Packed<T>::Dot(x.data(), y.data(), x.size());
+}
+
+template <class T>
+Cell proc_vec_sum(const Cell & a)
+{
+  const std::vector<T>& x = Data<T>(a);
+  return Packed<T>::Sum(x.data(), x.size());
+}
+
+template <class T>
+const std::vector<T>& NonEmpty(const Cell & a)
+{
+  const std::vector<T>& x = Data<T>(a);
+  if (x.empty())
+  {
+    std::cout << "empty " << Packed<T>::Name() << "\n";
+    exit(1);
+  }
+  return x;
+}
+
+template <class T>
+Cell proc_vec_min(const Cell & a)
+{
+  const std::vector<T>& x = NonEmpty<T>(a);
+  return Packed<T>::ToCell(Packed<T>::Min(x.data(), x.size()));
+}
+
+template <class T>
+Cell proc_vec_max(const Cell & a)
+{
+  const std::vector<T>& x = NonEmpty<T>(a);
+  return Packed<T>::ToCell(Packed<T>::Max(x.data(), x.size()));
+}
+
+template <class T>
+void AddGlobals(Env & env)
+{
+  const std::string name(Packed<T>::Name());
+  env[name]              = Cell(&proc_vec<T>);
+  env["make-" + name]    = Cell(&proc_make_vec<T>);
+  env["list->" + name]   = Cell(&proc_list_to_vec<T>);
+  env[name + "->list"]   = Cell(&proc_vec_to_list<T>);
+  env[name + "-length"]  = Cell(&proc_vec_length<T>);
+  env[name + "-ref"]     = Cell(&proc_vec_ref<T>);
+  env[name + "-add"]     = Cell(&proc_vec_add<T>);
+  env[name + "-mul"]     = Cell(&proc_vec_mul<T>);
+  env[name + "-scale"]   = Cell(&proc_vec_scale<T>);
+  env[name + "-dot"]     = Cell(&proc_vec_dot<T>);
+  env[name + "-sum"]     = Cell(&proc_vec_sum<T>);
+  env[name + "-min"]     = Cell(&proc_vec_min<T>);
+  env[name + "-max"]     = Cell(&proc_vec_max<T>);
+}
+
+}
+
+template <class T>
+std::string PackedVector<T>::ToString() const
+{
+  std::string s(Packed<T>::Type == F64Vector ? "#f64(" : "#s64(");
+  for (size_t i = 0; i < m_data.size(); ++i)
+    s += (i ? " " : "") + Packed<T>::ToCell(m_data[i]).ToString();
+  return s + ')';
+}
+
+template class mu::PackedVector<double>;
+template class mu::PackedVector<int64_t>;
+
+void mu::AddNumVecGlobals(Env& env)
+{
+  AddGlobals<double>(env);
+  AddGlobals<int64_t>(env);
+}
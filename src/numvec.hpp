@@ -0,0 +1,42 @@
+#ifndef __MU_NUMVEC_HPP__
+#define __MU_NUMVEC_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// a homogeneous numeric vector stored as one contiguous array: doubles
+// for an F64Vector cell, int64s for an S64Vector cell
+template <class T>
+class PackedVector : public Object
+{
+public:
+  PackedVector()
+  {
+  }
+
+  explicit PackedVector(size_t n, T fill = T())
+  : m_data(n, fill)
+  {
+  }
+
+  std::string ToString() const;
+
+  std::vector<T> m_data;
+};
+
+typedef PackedVector<double> F64Data;
+typedef PackedVector<int64_t> S64Data;
+
+// register the f64vector and s64vector primitives:
+//   (f64vector x ...)  (make-f64vector n [fill])  (list->f64vector l)
+//   (f64vector->list v)  (f64vector-length v)  (f64vector-ref v i)
+//   (f64vector-add a b)  (f64vector-mul a b)  (f64vector-scale v k)
+//   (f64vector-dot a b)  (f64vector-sum v)  (f64vector-min v)  (f64vector-max v)
+// and the same for s64vector, whose reductions are exact Numbers
+void AddNumVecGlobals(Env& env);
+
+}
+
+#endif
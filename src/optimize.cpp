@@ -0,0 +1,557 @@
+#include "optimize.hpp"
+#include "interpreter.hpp"
+#include <map>
+#include <sstream>
+
+using namespace mu;
+
+namespace {
+
+const char* PureNames[] = { "+", "-", "*", "/", "<", ">", "<=", "car", "cdr", "length", "null?", "equal?" };
+
+// the most nodes a lambda body may have to be inlined
+const size_t InlineSize = 32;
+
+std::mutex s_primitivesLock;
+std::map<std::string, Cell> s_primitives;
+
+bool SameProc(const Cell& a, const Cell& b)
+{
+  if (a.GetType() != Proc || b.GetType() != Proc || a.GetSharedObject() || b.GetSharedObject())
+    return false;
+  return a.GetProc() == b.GetProc() && a.GetArity() == b.GetArity() &&
+         (a.GetArity() < 0 || a.GetProc1() == b.GetProc1());
+}
+
+Cell MakeList(const Cells& parts)
+{
+  Cell list(List);
+  for (Cellit i = parts.begin(); i != parts.end(); ++i)
+    list.PushBack(*i);
+  return list;
+}
+
+// the value of x if it is a constant: a literal, quoted data, or a
+// rewritten expression that is one
+bool Constant(const Cell& x, Cell& value)
+{
+  switch (x.GetType())
+  {
+  case Number:
+  case String:
+  case Boolean:
+    value = x;
+    return true;
+  case Guarded:
+    return Constant(x.GetObject<GuardedExpr>()->GetFast(), value);
+  case List:
+    return Quoted(x, value);
+  default:
+    return false;
+  }
+}
+
+// code that evaluates to value
+Cell Literal(const Cell& value)
+{
+  if (value.GetType() == Number || value.GetType() == String || value.GetType() == Boolean)
+    return value;
+  Cells quoted;
+  quoted.push_back(Cell(Symbol, "quote"));
+  quoted.push_back(value);
+  return MakeList(quoted);
+}
+
+bool IsList(const Cell& c)
+{
+  return c.GetType() == List;
+}
+
+// whether calling the primitive 'name' with args can only return a value,
+// never report an error
+bool Foldable(const std::string& name, const Cells& args)
+{
+  if (name == "car")
+    return args.size() == 1 && IsList(args[0]) && args[0].ListSize() > 0;
+  if (name == "cdr" || name == "length" || name == "null?")
+    return args.size() == 1 && IsList(args[0]);
+  if (name == "equal?")
+    return args.size() == 2;
+  if (args.size() < 2)
+    return false;
+  for (size_t i = 0; i < args.size(); ++i)
+  {
+    if (args[i].GetType() != Number)
+      return false;
+    if (name == "/" && i > 0 && args[i].IsFixnum() && args[i].GetFixnum() == 0)
+      return false;
+  }
+  return true;
+}
+
+class Optimizer
+{
+public:
+  explicit Optimizer(Env& env)
+  : m_env(env), m_epoch(Env::epoch())
+  {
+  }
+
+  Cell Run(const Cell& x)
+  {
+    Collect(x);
+    bool changed = false;
+    return Rewrite(x, changed);
+  }
+
+private:
+  // every name x binds, at any depth, and how many times
+  void Collect(const Cell& x)
+  {
+    if (x.GetType() != List || x.ListSize() == 0)
+      return;
+    const Cells& xs = x.GetList();
+    if (xs[0].GetType() == Symbol)
+    {
+      const std::string& form = xs[0].GetVal();
+      if (form == "quote")
+        return;
+      if (form == "define-record-type")
+      {
+        CollectSymbols(x);
+        return;
+      }
+      if ((form == "define" || form == "set!") && xs.size() > 1 && xs[1].GetType() == Symbol)
+        ++m_bound[xs[1].GetVal()];
+      if (form == "lambda" && xs.size() > 1)
+        for (size_t i = 0; i < xs[1].ListSize(); ++i)
+          ++m_bound[xs[1].ListAt(i).GetVal()];
+    }
+    for (Cellit i = xs.begin(); i != xs.end(); ++i)
+      Collect(*i);
+  }
+
+  void CollectSymbols(const Cell& x)
+  {
+    if (x.GetType() == Symbol)
+      ++m_bound[x.GetVal()];
+    for (size_t i = 0; i < x.ListSize(); ++i)
+      CollectSymbols(x.ListAt(i));
+  }
+
+  Cell Guard(const Cell& fast, const Cell& original)
+  {
+    return Cell(Guarded, std::make_shared<GuardedExpr>(m_epoch, fast, original));
+  }
+
+  // the primitive that head names, if it is one of the pure ones
+  bool Pure(const Cell& x, Cell& proc)
+  {
+    const Cell& head = x.GetType() == Guarded ? x.GetObject<GuardedExpr>()->GetOriginal() : x;
+    if (head.GetType() != Symbol || m_bound.count(head.GetVal()))
+      return false;
+    Cell primitive;
+    {
+      std::lock_guard<std::mutex> lock(s_primitivesLock);
+      std::map<std::string, Cell>::const_iterator i = s_primitives.find(head.GetVal());
+      if (i == s_primitives.end())
+        return false;
+      primitive = i->second;
+    }
+    // sealed before it is looked up, so a rebinding in between is noticed
+    m_env.seal(head.GetVal());
+    return m_env.lookup(head.GetVal(), proc) && SameProc(primitive, proc);
+  }
+
+  // a reference to a global that was never rebound, as its value
+  Cell Reference(const Cell& x, bool& changed)
+  {
+    const std::string& name = x.GetVal();
+    if (m_bound.count(name) || m_env.reassigned(name))
+      return x;
+    m_env.seal(name);
+    Cell value;
+    if (!m_env.lookup(name, value))
+      return x;
+    changed = true;
+    return Guard(Literal(value), x);
+  }
+
+  // xs[first..] rewritten
+  Cells RewriteAll(const Cells& xs, size_t first, bool& changed)
+  {
+    Cells parts(xs.begin(), xs.begin() + first);
+    for (size_t i = first; i < xs.size(); ++i)
+      parts.push_back(Rewrite(xs[i], changed));
+    return parts;
+  }
+
+  Cell Rewrite(const Cell& x, bool& changed)
+  {
+    if (x.GetType() == Symbol)
+      return Reference(x, changed);
+    if (x.GetType() != List || x.ListSize() == 0)
+      return x;
+    const Cells& xs = x.GetList();
+    std::string form = xs[0].GetType() == Symbol && IsSpecialForm(xs[0].GetVal()) ? xs[0].GetVal() : "";
+    if (form == "quote" || form == "define-record-type")
+      return x;
+
+    Cell lifted;
+    if (form == "lambda" && Lift(x, lifted))
+      return changed = true, Rewrite(lifted, changed);
+
+    bool inner = false;
+    Cells parts;
+    if (form == "lambda" || form == "define" || form == "set!")
+      parts = RewriteAll(xs, 2, inner);
+    else
+      parts = RewriteAll(xs, 1, inner);
+    if (form.empty())
+      parts[0] = Rewrite(xs[0], inner);
+    changed = changed || inner;
+
+    Cell result;
+    if (form == "if" && Branch(x, parts, result))
+      return changed = true, result;
+    if (form == "begin" && Sequence(x, parts, result))
+      return changed = true, result;
+    if (form.empty() && (Fold(x, parts, result) || Inline(x, parts, result)))
+      return changed = true, result;
+    return inner ? MakeList(parts) : x;
+  }
+
+  // (if test conseq [alt]) with a constant boolean test
+  bool Branch(const Cell& x, const Cells& parts, Cell& result)
+  {
+    Cell test;
+    if (parts.size() < 3 || parts.size() > 4 || !Constant(parts[1], test) || test.GetType() != Boolean)
+      return false;
+    if (!test.GetBoolVal() && parts.size() < 4)
+      return false;
+    result = test.GetBoolVal() ? parts[2] : parts[3];
+    if (parts[1].GetType() == Guarded)
+      result = Guard(result, x);
+    return true;
+  }
+
+  // (begin exp ...) without the constants whose values are discarded
+  bool Sequence(const Cell& x, const Cells& parts, Cell& result)
+  {
+    if (parts.size() < 2)
+      return false;
+    Cells kept(1, parts[0]);
+    bool relied = false;
+    Cell value;
+    for (size_t i = 1; i < parts.size(); ++i)
+    {
+      if (i + 1 < parts.size() && Constant(parts[i], value))
+        relied = relied || parts[i].GetType() == Guarded;
+      else
+        kept.push_back(parts[i]);
+    }
+    if (kept.size() == parts.size() && kept.size() > 2)
+      return false;
+    result = kept.size() == 2 ? kept[1] : MakeList(kept);
+    if (relied)
+      result = Guard(result, x);
+    return true;
+  }
+
+  // a call to a pure primitive with constant arguments
+  bool Fold(const Cell& x, const Cells& parts, Cell& result)
+  {
+    Cell proc;
+    const Cell& head = x.ListAt(0);
+    if (!Pure(head, proc))
+      return false;
+    Cells args(parts.size() - 1);
+    for (size_t i = 1; i < parts.size(); ++i)
+      if (!Constant(parts[i], args[i - 1]))
+        return false;
+    if (!Foldable(head.GetVal(), args))
+      return false;
+    result = Guard(Literal(Apply(proc, args)), x);
+    return true;
+  }
+
+  // how a lambda body uses one of its parameters
+  struct Use
+  {
+    Use() : count(0), unconditional(false) {}
+    size_t count;
+    bool unconditional; // some use is evaluated whenever the body is
+  };
+
+  // x, without the rewrites of an earlier pass, with the symbols in args
+  // replaced by their arguments
+  Cell Substitute(const Cell& x, const std::map<std::string, Cell>& args)
+  {
+    if (x.GetType() == Guarded)
+      return Substitute(x.GetObject<GuardedExpr>()->GetOriginal(), args);
+    if (x.GetType() == Symbol)
+    {
+      std::map<std::string, Cell>::const_iterator i = args.find(x.GetVal());
+      return i == args.end() ? x : i->second;
+    }
+    Cell datum;
+    if (x.GetType() != List || Quoted(x, datum))
+      return x;
+    Cells parts;
+    for (size_t i = 0; i < x.ListSize(); ++i)
+      parts.push_back(Substitute(x.ListAt(i), args));
+    return MakeList(parts);
+  }
+
+  // whether the body x of the global lambda 'self' can be evaluated in
+  // place of a call to it: it binds nothing, does not call itself and
+  // none of its free names is bound by the code being optimized
+  bool Inlinable(const Cell& x, const std::set<std::string>& params, const std::string& self,
+                 bool conditional, size_t& size, std::map<std::string, Use>& uses)
+  {
+    if (++size > InlineSize)
+      return false;
+    if (x.GetType() == Symbol)
+    {
+      if (!params.count(x.GetVal()))
+        return x.GetVal() != self && !m_bound.count(x.GetVal());
+      Use& use = uses[x.GetVal()];
+      ++use.count;
+      use.unconditional = use.unconditional || !conditional;
+      return true;
+    }
+    Cell datum;
+    if (x.GetType() != List || x.ListSize() == 0 || Quoted(x, datum))
+      return true;
+    const Cells& xs = x.GetList();
+    size_t first = 0;
+    if (xs[0].GetType() == Symbol && IsSpecialForm(xs[0].GetVal()))
+    {
+      if (xs[0].GetVal() != "if" && xs[0].GetVal() != "begin")
+        return false;
+      first = 1;
+    }
+    for (size_t i = first; i < xs.size(); ++i)
+      if (!Inlinable(xs[i], params, self, conditional || (first && xs[0].GetVal() == "if" && i > 1), size, uses))
+        return false;
+    return true;
+  }
+
+  // whether evaluating x can only produce a value
+  bool PureExpression(const Cell& x)
+  {
+    Cell value, proc;
+    if (x.GetType() == Symbol || Constant(x, value))
+      return true;
+    if (x.GetType() == Guarded)
+      return PureExpression(x.GetObject<GuardedExpr>()->GetFast());
+    if (x.GetType() != List || x.ListSize() == 0 || !Pure(x.ListAt(0), proc))
+      return false;
+    for (size_t i = 1; i < x.ListSize(); ++i)
+      if (!PureExpression(x.ListAt(i)))
+        return false;
+    return true;
+  }
+
+  // a call to a small global lambda, replaced by its body with the
+  // arguments substituted for the parameters. Arguments must not change
+  // meaning when they are evaluated later, fewer times or more times
+  // than the call would evaluate them: constants and variables may go
+  // anywhere, a pure expression only where its parameter is used once
+  bool Inline(const Cell& x, const Cells& parts, Cell& result)
+  {
+    Cell proc;
+    if (parts[0].GetType() != Guarded || !Quoted(parts[0].GetObject<GuardedExpr>()->GetFast(), proc) ||
+        proc.GetType() != Lambda || proc.GetEnv() != &m_env || proc.ListSize() != 3)
+      return false;
+    const std::string& name = x.ListAt(0).GetVal();
+    const Cell& params = proc.ListAt(1);
+    if (m_inlining.count(name) || params.ListSize() != parts.size() - 1)
+      return false;
+
+    std::set<std::string> names;
+    for (size_t i = 0; i < params.ListSize(); ++i)
+      names.insert(params.ListAt(i).GetVal());
+    std::map<std::string, Cell> none;
+    Cell body(Substitute(proc.ListAt(2), none));
+    size_t size = 0;
+    std::map<std::string, Use> uses;
+    if (names.size() != params.ListSize() || !Inlinable(body, names, name, false, size, uses))
+      return false;
+
+    std::map<std::string, Cell> args;
+    for (size_t i = 0; i < params.ListSize(); ++i)
+    {
+      const Use& use = uses[params.ListAt(i).GetVal()];
+      const Cell& arg = parts[i + 1];
+      Cell value;
+      if (!Constant(arg, value) && !(use.unconditional && arg.GetType() == Symbol) &&
+          !(use.unconditional && use.count == 1 && PureExpression(arg)))
+        return false;
+      args[params.ListAt(i).GetVal()] = arg;
+    }
+
+    m_inlining.insert(name);
+    bool changed = false;
+    result = Guard(Rewrite(Substitute(body, args), changed), x);
+    m_inlining.erase(name);
+    return true;
+  }
+
+  // the names x refers to that are bound neither within x nor by scope
+  void FreeNames(const Cell& x, const std::set<std::string>& scope, std::set<std::string>& free)
+  {
+    if (x.GetType() == Symbol && !scope.count(x.GetVal()))
+      free.insert(x.GetVal());
+    Cell datum;
+    if (x.GetType() != List || x.ListSize() == 0 || Quoted(x, datum))
+      return;
+    const Cells& xs = x.GetList();
+    size_t first = 0;
+    if (xs[0].GetType() == Symbol && IsSpecialForm(xs[0].GetVal()))
+    {
+      first = 1;
+      if (xs[0].GetVal() == "define-record-type")
+        first = 0;
+      else if (xs[0].GetVal() == "lambda" && xs.size() > 2)
+      {
+        std::set<std::string> inner(scope);
+        for (size_t i = 0; i < xs[1].ListSize(); ++i)
+          inner.insert(xs[1].ListAt(i).GetVal());
+        for (size_t i = 2; i < xs.size(); ++i)
+          Defined(xs[i], inner);
+        for (size_t i = 2; i < xs.size(); ++i)
+          FreeNames(xs[i], inner, free);
+        return;
+      }
+    }
+    for (size_t i = first; i < xs.size(); ++i)
+      FreeNames(xs[i], scope, free);
+  }
+
+  // the names x defines in the frame it is evaluated in
+  void Defined(const Cell& x, std::set<std::string>& names)
+  {
+    Cell datum;
+    if (x.GetType() != List || x.ListSize() == 0 || Quoted(x, datum) || x.ListAt(0).GetVal() == "lambda")
+      return;
+    if (x.ListAt(0).GetVal() == "define" && x.ListSize() > 1)
+      names.insert(x.ListAt(1).GetVal());
+    for (size_t i = 1; i < x.ListSize(); ++i)
+      Defined(x.ListAt(i), names);
+  }
+
+  // (lambda params (begin (define f (lambda ...)) ... exp ...)) with the
+  // leading inner lambdas that only refer to globals and to each other
+  // bound once, as globals, instead of on every call. Their names are
+  // bound nowhere else in the code, so each reference can be renamed
+  // to the global; the new names cannot be read, so nothing else sees
+  // them. Inner lambdas that refer to the call's variables stay, and
+  // are made from the same code each time.
+  bool Lift(const Cell& x, Cell& result)
+  {
+    if (x.ListSize() != 3 || x.ListAt(2).GetType() != List || x.ListAt(2).ListSize() < 3 ||
+        x.ListAt(2).ListAt(0).GetVal() != "begin")
+      return false;
+    const Cells& body = x.ListAt(2).GetList();
+    std::map<std::string, Cell> candidates;
+    for (size_t i = 1; i + 1 < body.size(); ++i)
+    {
+      const Cell& d = body[i];
+      if (d.GetType() != List || d.ListSize() != 3 || d.ListAt(0).GetVal() != "define" ||
+          d.ListAt(1).GetType() != Symbol || d.ListAt(2).GetType() != List ||
+          d.ListAt(2).ListSize() != 3 || d.ListAt(2).ListAt(0).GetVal() != "lambda")
+        break;
+      if (m_bound[d.ListAt(1).GetVal()] == 1)
+        candidates[d.ListAt(1).GetVal()] = d.ListAt(2);
+    }
+
+    // drop the candidates that refer to a name bound in the code, other
+    // than a candidate, until none do
+    for (bool dropped = true; dropped;)
+    {
+      dropped = false;
+      for (std::map<std::string, Cell>::iterator c = candidates.begin(); c != candidates.end();)
+      {
+        std::set<std::string> scope, free;
+        FreeNames(c->second, scope, free);
+        bool local = false;
+        for (std::set<std::string>::const_iterator f = free.begin(); f != free.end(); ++f)
+          local = local || (m_bound.count(*f) && !candidates.count(*f));
+        if (local)
+        {
+          candidates.erase(c++);
+          dropped = true;
+        }
+        else
+          ++c;
+      }
+    }
+    if (candidates.empty())
+      return false;
+
+    std::map<std::string, Cell> names;
+    for (std::map<std::string, Cell>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+      std::ostringstream name;
+      name << c->first << " lifted#" << ++s_lifted;
+      names[c->first] = Cell(Symbol, name.str());
+      m_bound[name.str()] = 1; // looked up when called, not resolved now
+    }
+    for (std::map<std::string, Cell>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+      bool changed = false;
+      Cell proc(Rewrite(Substitute(c->second, names), changed));
+      proc.SetType(Lambda);
+      proc.SetEnv(&m_env);
+      m_env.define(names[c->first].GetVal(), proc);
+    }
+    for (std::map<std::string, Cell>::const_iterator n = names.begin(); n != names.end(); ++n)
+      m_bound.erase(n->second.GetVal());
+
+    Cells rest;
+    for (size_t i = 0; i < body.size(); ++i)
+      if (i == 0 || body[i].GetType() != List || body[i].ListAt(0).GetVal() != "define" ||
+          !candidates.count(body[i].ListAt(1).GetVal()))
+        rest.push_back(Substitute(body[i], names));
+    Cells lambda(x.GetList().begin(), x.GetList().begin() + 2);
+    lambda.push_back(rest.size() == 2 ? rest[1] : MakeList(rest));
+    result = MakeList(lambda);
+    return true;
+  }
+
+  static std::atomic<size_t> s_lifted;
+
+  Env& m_env;
+  uint64_t m_epoch;
+  std::map<std::string, size_t> m_bound;
+  std::set<std::string> m_inlining; // lambdas whose bodies are being inlined
+};
+
+std::atomic<size_t> Optimizer::s_lifted(0);
+
+}
+
+Cell mu::Optimize(const Cell& x, Env& env)
+{
+  return Optimizer(env).Run(x);
+}
+
+bool mu::Quoted(const Cell& x, Cell& datum)
+{
+  if (x.GetType() != List || x.ListSize() != 2 || x.ListAt(0).GetType() != Symbol || x.ListAt(0).GetVal() != "quote")
+    return false;
+  datum = x.ListAt(1);
+  return true;
+}
+
+void mu::RecordPrimitives(Env& env)
+{
+  std::lock_guard<std::mutex> lock(s_primitivesLock);
+  for (size_t i = 0; i < sizeof(PureNames) / sizeof(PureNames[0]); ++i)
+  {
+    Cell proc;
+    if (env.lookup(PureNames[i], proc))
+      s_primitives[PureNames[i]] = proc;
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef __MU_OPTIMIZE_HPP__
+#define __MU_OPTIMIZE_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// an expression Optimize rewrote on the assumption that some global
+// bindings keep their current values. Those bindings are sealed, so
+// rebinding one moves Env::epoch() on; from then on the original
+// expression is evaluated instead of the rewritten one.
+class GuardedExpr : public Object
+{
+public:
+  GuardedExpr(uint64_t epoch, const Cell& fast, const Cell& original)
+  : m_epoch(epoch), m_fast(fast), m_original(original)
+  {
+  }
+
+  // the expression to evaluate now
+  const Cell& Current() const
+  {
+    return Env::epoch() == m_epoch ? m_fast : m_original;
+  }
+
+  const Cell& GetFast() const
+  {
+    return m_fast;
+  }
+
+  const Cell& GetOriginal() const
+  {
+    return m_original;
+  }
+
+  std::string ToString() const
+  {
+    return Current().ToString();
+  }
+
+private:
+  uint64_t m_epoch;
+  Cell m_fast;
+  Cell m_original;
+};
+
+// rewrite the code x before it is evaluated in env, the global Env:
+//  - a reference to a global that has never been redefined or set! is
+//    replaced by its value;
+//  - calls to pure primitives (+ - * / < > <= car cdr length null?
+//    equal?) whose arguments are all constants are replaced by their
+//    value;
+//  - a call to a small, non-recursive global lambda is replaced by its
+//    body, when its arguments can be substituted for its parameters;
+//  - inner lambdas a lambda defines first in its body, that refer to
+//    nothing of the call's, are bound once as globals;
+//  - an if whose test is a constant boolean becomes the branch it picks;
+//  - a begin drops the constants whose values it discards, and is a
+//    constant itself when its last expression is.
+// A name bound anywhere in x (a parameter, a define, a set!) is never
+// taken to mean the global primitive. Quoted data is left alone.
+Cell Optimize(const Cell& x, Env& env);
+
+// whether x is the code (quote datum)
+bool Quoted(const Cell& x, Cell& datum);
+
+// remember the pure primitives as bound in env now; Optimize only folds
+// calls to a name that is still bound to the same primitive
+void RecordPrimitives(Env& env);
+
+}
+
+#endif
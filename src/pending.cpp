@@ -0,0 +1,28 @@
+#include "pending.hpp"
+
+using namespace mu;
+
+void PendingState::Complete(const Cell& value)
+{
+  m_value = value;
+  m_done = true;
+  if (m_waiter)
+    m_waiter->Wake();
+}
+
+Cell PendingState::Wait(EventLoop& loop)
+{
+  Task* task = Task::Current();
+  while (!m_done)
+  {
+    if (task)
+    {
+      m_waiter = task;
+      task->Park();
+    }
+    else
+      loop.Poll(-1);
+  }
+  m_waiter = nullptr;
+  return m_value;
+}
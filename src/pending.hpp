@@ -0,0 +1,44 @@
+#ifndef __MU_PENDING_HPP__
+#define __MU_PENDING_HPP__
+
+#include "cell.hpp"
+#include "eventloop.hpp"
+#include "task.hpp"
+
+namespace mu {
+
+// the not yet available result of an asynchronous primitive. Such a
+// primitive starts its work (usually by watching an fd on the thread's
+// EventLoop, or by posting back to it from a helper thread), returns a
+// Cell(Pending, state) straight away, and calls Complete() when done.
+class PendingState : public Object
+{
+public:
+  PendingState()
+  : m_done(false), m_waiter(nullptr)
+  {
+  }
+
+  // supply the result and wake the task waiting for it;
+  // must run on the thread owning the EventLoop
+  void Complete(const Cell& value);
+
+  bool IsDone() const
+  {
+    return m_done;
+  }
+
+  // return the result once it is available. Inside a Task the task is
+  // parked so its Scheduler can run other tasks meanwhile; outside of any
+  // task the loop is driven until the result arrives.
+  Cell Wait(EventLoop& loop);
+
+private:
+  bool m_done;
+  Cell m_value;
+  Task* m_waiter;
+};
+
+}
+
+#endif
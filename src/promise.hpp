@@ -0,0 +1,77 @@
+#ifndef __MU_PROMISE_HPP__
+#define __MU_PROMISE_HPP__
+
+#include "cell.hpp"
+#include <functional>
+
+namespace mu {
+
+// the result of (delay exp): exp and the Env to evaluate it in, or a host
+// thunk, until the first force and the value from then on. The thunk or
+// exp is dropped once the value is known, so a forced promise holds on to
+// nothing but its value. Like a list, a promise is meant to be forced by
+// one thread at a time.
+class PromiseState : public Object
+{
+public:
+  PromiseState(const Cell& expr, Env* env)
+  : m_forced(false), m_expr(expr), m_env(env)
+  {
+  }
+
+  explicit PromiseState(const std::function<Cell()>& thunk)
+  : m_forced(false), m_env(nullptr), m_thunk(thunk)
+  {
+  }
+
+  bool IsForced() const
+  {
+    return m_forced;
+  }
+
+  const Cell& GetValue() const
+  {
+    return m_value;
+  }
+
+  // the host thunk, handed over to the caller; empty for a delayed exp
+  std::function<Cell()> TakeThunk()
+  {
+    std::function<Cell()> thunk;
+    thunk.swap(m_thunk);
+    return thunk;
+  }
+
+  const Cell& GetExpr() const
+  {
+    return m_expr;
+  }
+
+  Env* GetEnv() const
+  {
+    return m_env;
+  }
+
+  // the first value computed wins, should forcing have re-entered
+  void Resolve(const Cell& value)
+  {
+    if (m_forced)
+      return;
+    m_forced = true;
+    m_value = value;
+    m_expr = Cell();
+    m_env = nullptr;
+    m_thunk = nullptr;
+  }
+
+private:
+  bool m_forced;
+  Cell m_value;
+  Cell m_expr;
+  Env* m_env;
+  std::function<Cell()> m_thunk;
+};
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "record.hpp"
+#include "native.hpp"
+#include <iostream>
+
+using namespace mu;
+
+namespace {
+
+// records are too small to carry a mutex each, so they share a few,
+// picked by address
+std::mutex& Stripe(const void* record)
+{
+  static std::mutex stripes[64];
+  return stripes[(reinterpret_cast<uintptr_t>(record) >> 4) % 64];
+}
+
+void Malformed(const std::string& why)
+{
+  std::cout << "bad define-record-type: " << why << "\n";
+  exit(1);
+}
+
+std::string Name(const Cell& c)
+{
+  if (c.GetType() != Symbol)
+    Malformed("not a name: " + c.ToString());
+  return c.GetVal();
+}
+
+size_t FieldIndex(const RecordType& type, const std::string& field)
+{
+  for (size_t i = 0; i < type.m_fields.size(); ++i)
+    if (type.m_fields[i] == field)
+      return i;
+  Malformed("unknown field " + field);
+  return 0;
+}
+
+void Define(Env* env, const std::string& name, const Signature& signature, const NativeProc::Function& fn)
+{
+  env->define(name, Cell(Proc, std::make_shared<NativeProc>(name, signature, fn)));
+}
+
+// the record in c if it is one of 'type', else an error naming 'proc'
+RecordData& Instance(const Cell& c, const RecordType* type, const std::string& proc)
+{
+  RecordData* record = c.GetType() == Record ? c.GetObject<RecordData>() : nullptr;
+  if (!record || record->GetRecordType() != type)
+  {
+    std::cout << "'" << proc << "' expects a " << type->m_name << ": " << c.ToString() << "\n";
+    exit(1);
+  }
+  return *record;
+}
+
+}
+
+RecordData::RecordData(const std::shared_ptr<const RecordType>& type)
+: m_type(type), m_fields(new Cell[type->m_fields.size()])
+{
+  for (size_t i = 0; i < type->m_fields.size(); ++i)
+    m_fields[i] = FalseBool;
+}
+
+std::string RecordData::ToString() const
+{
+  std::string s("#<" + m_type->m_name);
+  for (size_t i = 0; i < m_type->m_fields.size(); ++i)
+    s += ' ' + Get(i).ToString();
+  return s + '>';
+}
+
+Cell RecordData::Get(size_t field) const
+{
+  SpawnedLock lock(Stripe(this));
+  return m_fields[field];
+}
+
+void RecordData::Set(size_t field, const Cell& value)
+{
+  SpawnedLock lock(Stripe(this));
+  m_fields[field] = value;
+}
+
+Cell mu::DefineRecordType(const Cells& form, Env* env)
+{
+  if (form.size() < 4 || form[2].GetType() != List || form[2].ListSize() == 0)
+    Malformed("expected (define-record-type name (constructor field ...) predicate field-spec ...)");
+
+  std::shared_ptr<RecordType> type(new RecordType);
+  type->m_name = Name(form[1]);
+  for (size_t i = 4; i < form.size(); ++i)
+  {
+    if (form[i].GetType() != List || form[i].ListSize() < 2 || form[i].ListSize() > 3)
+      Malformed("expected (field accessor [modifier]): " + form[i].ToString());
+    type->m_fields.push_back(Name(form[i].ListAt(0)));
+  }
+  std::shared_ptr<const RecordType> shared(type);
+  const RecordType* id = shared.get();
+
+  const Cells& constructor = form[2].GetList();
+  std::vector<size_t> slots;
+  for (size_t i = 1; i < constructor.size(); ++i)
+    slots.push_back(FieldIndex(*type, Name(constructor[i])));
+  Define(env, Name(constructor[0]), Signature(slots.size()), [shared, slots](const Cells& args) {
+    std::shared_ptr<RecordData> record(new RecordData(shared));
+    for (size_t i = 0; i < slots.size(); ++i)
+      record->Set(slots[i], args[i]);
+    return Cell(Record, record);
+  });
+
+  Define(env, Name(form[3]), Signature(1), [id](const Cells& args) {
+    return MakeBool(args[0].GetType() == Record && args[0].GetObject<RecordData>()->GetRecordType() == id);
+  });
+
+  for (size_t i = 4; i < form.size(); ++i)
+  {
+    size_t slot = i - 4;
+    std::string accessor(Name(form[i].ListAt(1)));
+    Define(env, accessor, Signature(1), [id, slot, accessor](const Cells& args) {
+      return Instance(args[0], id, accessor).Get(slot);
+    });
+    if (form[i].ListSize() < 3)
+      continue;
+    std::string modifier(Name(form[i].ListAt(2)));
+    Define(env, modifier, Signature(2), [id, slot, modifier](const Cells& args) {
+      Instance(args[0], id, modifier).Set(slot, args[1]);
+      return args[1];
+    });
+  }
+  return form[1];
+}
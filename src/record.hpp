@@ -0,0 +1,48 @@
+#ifndef __MU_RECORD_HPP__
+#define __MU_RECORD_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// what every record made by one define-record-type shares
+struct RecordType
+{
+  std::string m_name;
+  std::vector<std::string> m_fields;
+};
+
+// an instance of a record type: one slot per field, allocated once at
+// the size the type fixes, and shared by every copy of its Cell
+class RecordData : public Object
+{
+public:
+  explicit RecordData(const std::shared_ptr<const RecordType>& type);
+
+  std::string ToString() const;
+
+  const RecordType* GetRecordType() const
+  {
+    return m_type.get();
+  }
+
+  Cell Get(size_t field) const;
+  void Set(size_t field, const Cell& value);
+
+private:
+  std::shared_ptr<const RecordType> m_type;
+  std::unique_ptr<Cell[]> m_fields;
+};
+
+// evaluate (define-record-type name (constructor field ...) predicate
+// (field accessor [modifier]) ...): define the constructor, predicate,
+// accessors and modifiers in env and return the name. Each accessor is
+// a NativeProc that knows its field's slot, so a call checks the type
+// and loads the slot directly. Fields the constructor does not take
+// start out #f.
+Cell DefineRecordType(const Cells& form, Env* env);
+
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include "rope.hpp"
+#include "number.hpp"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+using namespace mu;
+
+namespace {
+
+typedef std::shared_ptr<const RopeNode> NodePtr;
+typedef std::shared_ptr<const std::string> TextPtr;
+
+// joined leaves no longer than this are copied into one, and results no
+// longer than this are returned as plain strings
+const size_t LeafSize = 512;
+
+}
+
+// a leaf, holding m_length bytes of *m_text from m_offset, or an inner
+// node joining m_left and m_right
+struct mu::RopeNode
+{
+  TextPtr m_text;
+  size_t m_offset;
+  NodePtr m_left;
+  NodePtr m_right;
+  size_t m_length;
+  int m_height; // 0 for a leaf
+};
+
+namespace {
+
+int Height(const NodePtr& n)
+{
+  return n ? n->m_height : -1;
+}
+
+NodePtr Leaf(const TextPtr& text, size_t offset, size_t length)
+{
+  if (!length)
+    return nullptr;
+  return NodePtr(new RopeNode{text, offset, nullptr, nullptr, length, 0});
+}
+
+NodePtr Node(const NodePtr& left, const NodePtr& right)
+{
+  int height = 1 + std::max(left->m_height, right->m_height);
+  return NodePtr(new RopeNode{nullptr, 0, left, right, left->m_length + right->m_length, height});
+}
+
+void Flatten(const RopeNode& n, std::string& out)
+{
+  if (n.m_text)
+    out.append(*n.m_text, n.m_offset, n.m_length);
+  else
+  {
+    Flatten(*n.m_left, out);
+    Flatten(*n.m_right, out);
+  }
+}
+
+// a node over left and right, whose heights differ by at most two,
+// rotated so that they differ by at most one
+NodePtr Balance(const NodePtr& l, const NodePtr& r)
+{
+  if (l->m_height > r->m_height + 1)
+  {
+    if (Height(l->m_left) >= Height(l->m_right))
+      return Node(l->m_left, Node(l->m_right, r));
+    return Node(Node(l->m_left, l->m_right->m_left), Node(l->m_right->m_right, r));
+  }
+  if (r->m_height > l->m_height + 1)
+  {
+    if (Height(r->m_right) >= Height(r->m_left))
+      return Node(Node(l, r->m_left), r->m_right);
+    return Node(Node(l, r->m_left->m_left), Node(r->m_left->m_right, r->m_right));
+  }
+  return Node(l, r);
+}
+
+// a followed by b: walks down the side of the taller tree to a subtree
+// as tall as the shorter one and rebalances on the way back up
+NodePtr Join(const NodePtr& a, const NodePtr& b)
+{
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (a->m_text && b->m_text && a->m_length + b->m_length <= LeafSize)
+  {
+    std::string* text(new std::string);
+    text->reserve(a->m_length + b->m_length);
+    Flatten(*a, *text);
+    Flatten(*b, *text);
+    return Leaf(TextPtr(text), 0, text->size());
+  }
+  if (a->m_height > b->m_height + 1)
+    return Balance(a->m_left, Join(a->m_right, b));
+  if (b->m_height > a->m_height + 1)
+    return Balance(Join(a, b->m_left), b->m_right);
+  return Node(a, b);
+}
+
+// bytes [begin, end) of n, sharing every subtree that lies inside them
+NodePtr Slice(const NodePtr& n, size_t begin, size_t end)
+{
+  if (begin == 0 && end == n->m_length)
+    return n;
+  if (n->m_text)
+    return Leaf(n->m_text, n->m_offset + begin, end - begin);
+  size_t split = n->m_left->m_length;
+  if (end <= split)
+    return Slice(n->m_left, begin, end);
+  if (begin >= split)
+    return Slice(n->m_right, begin - split, end - split);
+  return Join(Slice(n->m_left, begin, split), Slice(n->m_right, 0, end - split));
+}
+
+void CheckString(const Cell& s)
+{
+  if (s.GetType() != String)
+  {
+    std::cout << "string expected: " << s.ToString() << "\n";
+    exit(1);
+  }
+}
+
+const Rope* GetRope(const Cell& s)
+{
+  CheckString(s);
+  return s.GetObject<Rope>();
+}
+
+NodePtr Root(const Cell& s)
+{
+  const Rope* rope = GetRope(s);
+  if (rope)
+    return rope->GetRoot();
+  TextPtr text(new std::string(s.GetVal()));
+  return Leaf(text, 0, text->size());
+}
+
+size_t Length(const Cell& s)
+{
+  const Rope* rope = GetRope(s);
+  return rope ? rope->Length() : s.GetVal().size();
+}
+
+Cell MakeString(const NodePtr& root)
+{
+  if (!root)
+    return Cell(String, "");
+  if (root->m_length <= LeafSize)
+  {
+    std::string text;
+    Flatten(*root, text);
+    return Cell(String, text);
+  }
+  return Cell(String, std::make_shared<Rope>(root));
+}
+
+size_t Position(const Cell& i, size_t length)
+{
+  if (i.GetType() != Number || !i.IsFixnum() || i.GetFixnum() < 0 || uint64_t(i.GetFixnum()) > length)
+  {
+    std::cout << "index out of range: " << i.ToString() << "\n";
+    exit(1);
+  }
+  return size_t(i.GetFixnum());
+}
+
+Cell proc_string_append(const Cells & c)
+{
+  NodePtr root;
+  for (Cellit i = c.begin(); i != c.end(); ++i)
+    root = Join(root, Root(*i));
+  return MakeString(root);
+}
+
+Cell proc_substring(const Cells & c)
+{
+  if (c.size() < 2 || c.size() > 3)
+  {
+    std::cout << "substring takes a string, a start and an optional end\n";
+    exit(1);
+  }
+  size_t length = Length(c[0]);
+  size_t begin = Position(c[1], length);
+  size_t end = c.size() > 2 ? Position(c[2], length) : length;
+  if (begin > end)
+  {
+    std::cout << "substring start is past its end\n";
+    exit(1);
+  }
+  if (begin == end)
+    return Cell(String, "");
+  return MakeString(Slice(Root(c[0]), begin, end));
+}
+
+Cell proc_string_length(const Cell & s)
+{
+  return MakeFixnum(Length(s));
+}
+
+}
+
+std::string Rope::ToString() const
+{
+  // a whole string, such as an interned literal, needs no flat copy
+  if (m_root->m_text && m_root->m_offset == 0 && m_root->m_length == m_root->m_text->size())
+    return *m_root->m_text;
+  std::call_once(m_flattenOnce, [this]() {
+    m_flat.reserve(m_root->m_length);
+    Flatten(*m_root, m_flat);
+  });
+  return m_flat;
+}
+
+size_t Rope::Length() const
+{
+  return m_root->m_length;
+}
+
+int Rope::Depth() const
+{
+  return m_root->m_height;
+}
+
+Cell mu::InternString(const std::string& text)
+{
+  static const size_t inlineSize = std::string().capacity();
+  if (text.size() <= inlineSize)
+    return Cell(String, text);
+
+  typedef std::unordered_map<std::string, std::shared_ptr<Object> > Pool;
+  static std::mutex poolLock;
+  static Pool* pool = new Pool; // never freed: the leaves point into its keys
+  std::lock_guard<std::mutex> lock(poolLock);
+  Pool::iterator i = pool->find(text);
+  if (i == pool->end())
+  {
+    i = pool->insert(Pool::value_type(text, nullptr)).first;
+    TextPtr key(TextPtr(), &i->first);
+    i->second = std::make_shared<Rope>(Leaf(key, 0, text.size()));
+  }
+  return Cell(String, i->second);
+}
+
+void mu::AddRopeGlobals(Env& env)
+{
+  env["string-append"] = Cell(&proc_string_append);
+  env["substring"]     = Cell(&proc_substring);
+  env["string-length"] = Cell(&proc_string_length);
+}
@@ -0,0 +1,56 @@
+#ifndef __MU_ROPE_HPP__
+#define __MU_ROPE_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+struct RopeNode; // defined in rope.cpp
+
+// the text of a long String cell built by string-append or substring: an
+// immutable, height-balanced tree whose leaves are slices of shared
+// strings, so joining two ropes or taking a slice of one costs O(log n)
+// new nodes rather than a copy of the text. The text is put together
+// the first time something asks for it as one string (GetVal, printing)
+// and kept from then on.
+class Rope : public Object
+{
+public:
+  explicit Rope(const std::shared_ptr<const RopeNode>& root)
+  : m_root(root)
+  {
+  }
+
+  // the text
+  std::string ToString() const;
+
+  const std::shared_ptr<const RopeNode>& GetRoot() const
+  {
+    return m_root;
+  }
+
+  size_t Length() const;
+  // the number of levels of the tree; a single leaf has depth 0
+  int Depth() const;
+
+private:
+  std::shared_ptr<const RopeNode> m_root;
+  mutable std::once_flag m_flattenOnce;
+  mutable std::string m_flat;
+};
+
+// a String cell for a literal read from source. Text that fits in the
+// std::string's own inline buffer (15 bytes with libstdc++) stays in the
+// Cell; longer literals are interned in a pool that lives as long as the
+// program, so every occurrence of the same text shares one Rope leaf
+Cell InternString(const std::string& text);
+
+// register (string-append s ...), (substring s start [end]) and
+// (string-length s). Results longer than a leaf are Ropes; shorter ones
+// are plain String cells
+void AddRopeGlobals(Env& env);
+
+}
+
+#endif
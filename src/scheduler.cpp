@@ -0,0 +1,36 @@
+#include "scheduler.hpp"
+
+using namespace mu;
+
+bool Scheduler::RunOnce()
+{
+  for (size_t n = m_ready.size(); n; --n)
+  {
+    std::shared_ptr<Task> task(m_ready.front());
+    m_ready.pop_front();
+    if (task->Resume())
+      continue;
+    if (task->IsParked())
+      m_parked[task.get()] = task;
+    else
+      m_ready.push_back(task);
+  }
+  if (!m_parked.empty())
+    m_loop.Poll(m_ready.empty() ? -1 : 0);
+  return !IsEmpty();
+}
+
+void Scheduler::Run()
+{
+  while (RunOnce())
+    ;
+}
+
+void Scheduler::Wake(Task* task)
+{
+  std::map<Task*, std::shared_ptr<Task> >::iterator i = m_parked.find(task);
+  if (i == m_parked.end())
+    return; // woken before Resume() returned; RunOnce() requeues it
+  m_ready.push_back(i->second);
+  m_parked.erase(i);
+}
@@ -0,0 +1,51 @@
+#ifndef __MU_SCHEDULER_HPP__
+#define __MU_SCHEDULER_HPP__
+
+#include "eventloop.hpp"
+#include "task.hpp"
+#include <deque>
+#include <map>
+#include <memory>
+
+namespace mu {
+
+// interleaves Tasks on the calling thread, round robin, and polls the
+// EventLoop for the completions parked tasks are waiting on
+class Scheduler
+{
+public:
+  explicit Scheduler(EventLoop& loop = EventLoop::Default())
+  : m_loop(loop)
+  {
+  }
+
+  void Add(const std::shared_ptr<Task>& task)
+  {
+    task->SetScheduler(this);
+    m_ready.push_back(task);
+  }
+
+  // resume every ready task once, then poll the loop (blocking only when
+  // nothing is ready); return false when no task is left
+  bool RunOnce();
+
+  // run until every task has finished
+  void Run();
+
+  // move a parked task back to the ready queue; called by Task::Wake()
+  void Wake(Task* task);
+
+  bool IsEmpty() const
+  {
+    return m_ready.empty() && m_parked.empty();
+  }
+
+private:
+  EventLoop& m_loop;
+  std::deque<std::shared_ptr<Task> > m_ready;
+  std::map<Task*, std::shared_ptr<Task> > m_parked;
+};
+
+}
+
+#endif
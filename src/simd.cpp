@@ -0,0 +1,876 @@
+#include "simd.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MU_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace mu;
+
+namespace {
+
+// every implementation folds its eight lanes in this order
+double FoldSum(const double* lanes)
+{
+  return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+double FoldMin(const double* lanes)
+{
+  double m = lanes[0];
+  for (int k = 1; k < 8; ++k)
+    m = lanes[k] < m ? lanes[k] : m;
+  return m;
+}
+
+double FoldMax(const double* lanes)
+{
+  double m = lanes[0];
+  for (int k = 1; k < 8; ++k)
+    m = lanes[k] > m ? lanes[k] : m;
+  return m;
+}
+
+// int64 arithmetic is done unsigned so that wrapping is well defined
+inline int64_t WrapAdd(int64_t a, int64_t b)
+{
+  return int64_t(uint64_t(a) + uint64_t(b));
+}
+
+inline int64_t WrapMul(int64_t a, int64_t b)
+{
+  return int64_t(uint64_t(a) * uint64_t(b));
+}
+
+inline int64_t WrapSub(int64_t a, int64_t b)
+{
+  return int64_t(uint64_t(a) - uint64_t(b));
+}
+
+////////////////////// portable C++
+
+void AddF64Scalar(const double* a, const double* b, double* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = a[i] + b[i];
+}
+
+void MulF64Scalar(const double* a, const double* b, double* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = a[i] * b[i];
+}
+
+void ScaleF64Scalar(const double* a, double k, double* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = a[i] * k;
+}
+
+double SumF64Scalar(const double* a, size_t n)
+{
+  double lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    for (int k = 0; k < 8; ++k)
+      lanes[k] += a[i + k];
+  double r = FoldSum(lanes);
+  for (; i < n; ++i)
+    r += a[i];
+  return r;
+}
+
+double DotF64Scalar(const double* a, const double* b, size_t n)
+{
+  double lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    for (int k = 0; k < 8; ++k)
+      lanes[k] += a[i + k] * b[i + k];
+  double r = FoldSum(lanes);
+  for (; i < n; ++i)
+    r += a[i] * b[i];
+  return r;
+}
+
+double MinF64Scalar(const double* a, size_t n)
+{
+  double m = a[0];
+  for (size_t i = 1; i < n; ++i)
+    m = a[i] < m ? a[i] : m;
+  return m;
+}
+
+double MaxF64Scalar(const double* a, size_t n)
+{
+  double m = a[0];
+  for (size_t i = 1; i < n; ++i)
+    m = a[i] > m ? a[i] : m;
+  return m;
+}
+
+void AddS64Scalar(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = WrapAdd(a[i], b[i]);
+}
+
+void MulS64Scalar(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = WrapMul(a[i], b[i]);
+}
+
+void ScaleS64Scalar(const int64_t* a, int64_t k, int64_t* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = WrapMul(a[i], k);
+}
+
+int64_t SumS64Scalar(const int64_t* a, size_t n)
+{
+  int64_t r = 0;
+  for (size_t i = 0; i < n; ++i)
+    r = WrapAdd(r, a[i]);
+  return r;
+}
+
+int64_t DotS64Scalar(const int64_t* a, const int64_t* b, size_t n)
+{
+  int64_t r = 0;
+  for (size_t i = 0; i < n; ++i)
+    r = WrapAdd(r, WrapMul(a[i], b[i]));
+  return r;
+}
+
+int64_t MinS64Scalar(const int64_t* a, size_t n)
+{
+  int64_t m = a[0];
+  for (size_t i = 1; i < n; ++i)
+    m = a[i] < m ? a[i] : m;
+  return m;
+}
+
+int64_t MaxS64Scalar(const int64_t* a, size_t n)
+{
+  int64_t m = a[0];
+  for (size_t i = 1; i < n; ++i)
+    m = a[i] > m ? a[i] : m;
+  return m;
+}
+
+void SubF64Scalar(const double* a, const double* b, double* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = a[i] - b[i];
+}
+
+void DivF64Scalar(const double* a, const double* b, double* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = a[i] / b[i];
+}
+
+void SubS64Scalar(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = WrapSub(a[i], b[i]);
+}
+
+void LessF64Scalar(const double* a, const double* b, int64_t* mask, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    mask[i] = a[i] < b[i] ? -1 : 0;
+}
+
+void LessEqualF64Scalar(const double* a, const double* b, int64_t* mask, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    mask[i] = a[i] > b[i] ? 0 : -1;
+}
+
+void LessS64Scalar(const int64_t* a, const int64_t* b, int64_t* mask, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    mask[i] = a[i] < b[i] ? -1 : 0;
+}
+
+void LessEqualS64Scalar(const int64_t* a, const int64_t* b, int64_t* mask, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    mask[i] = a[i] > b[i] ? 0 : -1;
+}
+
+void AndMaskScalar(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = a[i] & b[i];
+}
+
+void SelectF64Scalar(const int64_t* mask, const double* a, const double* b, double* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = mask[i] ? a[i] : b[i];
+}
+
+void SelectS64Scalar(const int64_t* mask, const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = mask[i] ? a[i] : b[i];
+}
+
+#ifdef MU_SIMD_X86
+
+////////////////////// SSE2 (always present on x86-64)
+
+__attribute__((target("sse2")))
+void AddF64Sse2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  AddF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void MulF64Sse2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  MulF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void ScaleF64Sse2(const double* a, double k, double* out, size_t n)
+{
+  const __m128d kk = _mm_set1_pd(k);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), kk));
+  ScaleF64Scalar(a + i, k, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+double SumF64Sse2(const double* a, size_t n)
+{
+  __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+    s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    s2 = _mm_add_pd(s2, _mm_loadu_pd(a + i + 4));
+    s3 = _mm_add_pd(s3, _mm_loadu_pd(a + i + 6));
+  }
+  double lanes[8];
+  _mm_storeu_pd(lanes, s0);
+  _mm_storeu_pd(lanes + 2, s1);
+  _mm_storeu_pd(lanes + 4, s2);
+  _mm_storeu_pd(lanes + 6, s3);
+  double r = FoldSum(lanes);
+  for (; i < n; ++i)
+    r += a[i];
+  return r;
+}
+
+__attribute__((target("sse2")))
+double DotF64Sse2(const double* a, const double* b, size_t n)
+{
+  __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    s2 = _mm_add_pd(s2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+    s3 = _mm_add_pd(s3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+  }
+  double lanes[8];
+  _mm_storeu_pd(lanes, s0);
+  _mm_storeu_pd(lanes + 2, s1);
+  _mm_storeu_pd(lanes + 4, s2);
+  _mm_storeu_pd(lanes + 6, s3);
+  double r = FoldSum(lanes);
+  for (; i < n; ++i)
+    r += a[i] * b[i];
+  return r;
+}
+
+__attribute__((target("sse2")))
+double MinF64Sse2(const double* a, size_t n)
+{
+  if (n < 8)
+    return MinF64Scalar(a, n);
+  __m128d m0 = _mm_loadu_pd(a), m1 = _mm_loadu_pd(a + 2), m2 = _mm_loadu_pd(a + 4), m3 = _mm_loadu_pd(a + 6);
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8)
+  {
+    // minpd(x, m) is x < m ? x : m, like the scalar loop
+    m0 = _mm_min_pd(_mm_loadu_pd(a + i), m0);
+    m1 = _mm_min_pd(_mm_loadu_pd(a + i + 2), m1);
+    m2 = _mm_min_pd(_mm_loadu_pd(a + i + 4), m2);
+    m3 = _mm_min_pd(_mm_loadu_pd(a + i + 6), m3);
+  }
+  double lanes[8];
+  _mm_storeu_pd(lanes, m0);
+  _mm_storeu_pd(lanes + 2, m1);
+  _mm_storeu_pd(lanes + 4, m2);
+  _mm_storeu_pd(lanes + 6, m3);
+  double m = FoldMin(lanes);
+  for (; i < n; ++i)
+    m = a[i] < m ? a[i] : m;
+  return m;
+}
+
+__attribute__((target("sse2")))
+double MaxF64Sse2(const double* a, size_t n)
+{
+  if (n < 8)
+    return MaxF64Scalar(a, n);
+  __m128d m0 = _mm_loadu_pd(a), m1 = _mm_loadu_pd(a + 2), m2 = _mm_loadu_pd(a + 4), m3 = _mm_loadu_pd(a + 6);
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8)
+  {
+    m0 = _mm_max_pd(_mm_loadu_pd(a + i), m0);
+    m1 = _mm_max_pd(_mm_loadu_pd(a + i + 2), m1);
+    m2 = _mm_max_pd(_mm_loadu_pd(a + i + 4), m2);
+    m3 = _mm_max_pd(_mm_loadu_pd(a + i + 6), m3);
+  }
+  double lanes[8];
+  _mm_storeu_pd(lanes, m0);
+  _mm_storeu_pd(lanes + 2, m1);
+  _mm_storeu_pd(lanes + 4, m2);
+  _mm_storeu_pd(lanes + 6, m3);
+  double m = FoldMax(lanes);
+  for (; i < n; ++i)
+    m = a[i] > m ? a[i] : m;
+  return m;
+}
+
+__attribute__((target("sse2")))
+void AddS64Sse2(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi64(x, y));
+  }
+  AddS64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+int64_t SumS64Sse2(const int64_t* a, size_t n)
+{
+  __m128i s0 = _mm_setzero_si128(), s1 = s0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    s0 = _mm_add_epi64(s0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    s1 = _mm_add_epi64(s1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 2)));
+  }
+  int64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(s0, s1));
+  return WrapAdd(WrapAdd(lanes[0], lanes[1]), SumS64Scalar(a + i, n - i));
+}
+
+__attribute__((target("sse2")))
+void SubF64Sse2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(out + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  SubF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void DivF64Sse2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(out + i, _mm_div_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  DivF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SubS64Sse2(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi64(x, y));
+  }
+  SubS64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void LessF64Sse2(const double* a, const double* b, int64_t* mask, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128d m = _mm_cmplt_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), _mm_castpd_si128(m));
+  }
+  LessF64Scalar(a + i, b + i, mask + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void LessEqualF64Sse2(const double* a, const double* b, int64_t* mask, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    // "not greater" is true for NaN, where "less or equal" is not
+    __m128d m = _mm_cmpngt_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), _mm_castpd_si128(m));
+  }
+  LessEqualF64Scalar(a + i, b + i, mask + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void AndMaskSse2(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(x, y));
+  }
+  AndMaskScalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SelectF64Sse2(const int64_t* mask, const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128d m = _mm_castsi128_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i)));
+    _mm_storeu_pd(out + i, _mm_or_pd(_mm_and_pd(m, _mm_loadu_pd(a + i)), _mm_andnot_pd(m, _mm_loadu_pd(b + i))));
+  }
+  SelectF64Scalar(mask + i, a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SelectS64Sse2(const int64_t* mask, const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i));
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, y)));
+  }
+  SelectS64Scalar(mask + i, a + i, b + i, out + i, n - i);
+}
+
+////////////////////// AVX2
+
+__attribute__((target("avx2")))
+void AddF64Avx2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  AddF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void MulF64Avx2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  MulF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void ScaleF64Avx2(const double* a, double k, double* out, size_t n)
+{
+  const __m256d kk = _mm256_set1_pd(k);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kk));
+  ScaleF64Scalar(a + i, k, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+double SumF64Avx2(const double* a, size_t n)
+{
+  __m256d s0 = _mm256_setzero_pd(), s1 = s0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+    s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+  }
+  double lanes[8];
+  _mm256_storeu_pd(lanes, s0);
+  _mm256_storeu_pd(lanes + 4, s1);
+  double r = FoldSum(lanes);
+  for (; i < n; ++i)
+    r += a[i];
+  return r;
+}
+
+__attribute__((target("avx2")))
+double DotF64Avx2(const double* a, const double* b, size_t n)
+{
+  // multiply then add rather than FMA, to round like the other kernels
+  __m256d s0 = _mm256_setzero_pd(), s1 = s0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+  }
+  double lanes[8];
+  _mm256_storeu_pd(lanes, s0);
+  _mm256_storeu_pd(lanes + 4, s1);
+  double r = FoldSum(lanes);
+  for (; i < n; ++i)
+    r += a[i] * b[i];
+  return r;
+}
+
+__attribute__((target("avx2")))
+double MinF64Avx2(const double* a, size_t n)
+{
+  if (n < 8)
+    return MinF64Scalar(a, n);
+  __m256d m0 = _mm256_loadu_pd(a), m1 = _mm256_loadu_pd(a + 4);
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8)
+  {
+    m0 = _mm256_min_pd(_mm256_loadu_pd(a + i), m0);
+    m1 = _mm256_min_pd(_mm256_loadu_pd(a + i + 4), m1);
+  }
+  double lanes[8];
+  _mm256_storeu_pd(lanes, m0);
+  _mm256_storeu_pd(lanes + 4, m1);
+  double m = FoldMin(lanes);
+  for (; i < n; ++i)
+    m = a[i] < m ? a[i] : m;
+  return m;
+}
+
+__attribute__((target("avx2")))
+double MaxF64Avx2(const double* a, size_t n)
+{
+  if (n < 8)
+    return MaxF64Scalar(a, n);
+  __m256d m0 = _mm256_loadu_pd(a), m1 = _mm256_loadu_pd(a + 4);
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8)
+  {
+    m0 = _mm256_max_pd(_mm256_loadu_pd(a + i), m0);
+    m1 = _mm256_max_pd(_mm256_loadu_pd(a + i + 4), m1);
+  }
+  double lanes[8];
+  _mm256_storeu_pd(lanes, m0);
+  _mm256_storeu_pd(lanes + 4, m1);
+  double m = FoldMax(lanes);
+  for (; i < n; ++i)
+    m = a[i] > m ? a[i] : m;
+  return m;
+}
+
+__attribute__((target("avx2")))
+void AddS64Avx2(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi64(x, y));
+  }
+  AddS64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+int64_t SumS64Avx2(const int64_t* a, size_t n)
+{
+  __m256i s0 = _mm256_setzero_si256(), s1 = s0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    s0 = _mm256_add_epi64(s0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+    s1 = _mm256_add_epi64(s1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 4)));
+  }
+  int64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(s0, s1));
+  int64_t r = WrapAdd(WrapAdd(lanes[0], lanes[1]), WrapAdd(lanes[2], lanes[3]));
+  return WrapAdd(r, SumS64Scalar(a + i, n - i));
+}
+
+__attribute__((target("avx2")))
+int64_t MinS64Avx2(const int64_t* a, size_t n)
+{
+  if (n < 4)
+    return MinS64Scalar(a, n);
+  __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  size_t i = 4;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(m, x));
+  }
+  int64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), m);
+  int64_t r = MinS64Scalar(lanes, 4);
+  for (; i < n; ++i)
+    r = a[i] < r ? a[i] : r;
+  return r;
+}
+
+__attribute__((target("avx2")))
+int64_t MaxS64Avx2(const int64_t* a, size_t n)
+{
+  if (n < 4)
+    return MaxS64Scalar(a, n);
+  __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  size_t i = 4;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(x, m));
+  }
+  int64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), m);
+  int64_t r = MaxS64Scalar(lanes, 4);
+  for (; i < n; ++i)
+    r = a[i] > r ? a[i] : r;
+  return r;
+}
+
+__attribute__((target("avx2")))
+void SubF64Avx2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  SubF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void DivF64Avx2(const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  DivF64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void SubS64Avx2(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_sub_epi64(x, y));
+  }
+  SubS64Scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void LessF64Avx2(const double* a, const double* b, int64_t* mask, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d m = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_LT_OQ);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + i), _mm256_castpd_si256(m));
+  }
+  LessF64Scalar(a + i, b + i, mask + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void LessEqualF64Avx2(const double* a, const double* b, int64_t* mask, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d m = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_NGT_UQ);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + i), _mm256_castpd_si256(m));
+  }
+  LessEqualF64Scalar(a + i, b + i, mask + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void LessS64Avx2(const int64_t* a, const int64_t* b, int64_t* mask, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + i), _mm256_cmpgt_epi64(y, x));
+  }
+  LessS64Scalar(a + i, b + i, mask + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void LessEqualS64Avx2(const int64_t* a, const int64_t* b, int64_t* mask, size_t n)
+{
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + i), _mm256_xor_si256(_mm256_cmpgt_epi64(x, y), ones));
+  }
+  LessEqualS64Scalar(a + i, b + i, mask + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void AndMaskAvx2(const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(x, y));
+  }
+  AndMaskScalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void SelectF64Avx2(const int64_t* mask, const double* a, const double* b, double* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d m = _mm256_castsi256_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i)));
+    _mm256_storeu_pd(out + i, _mm256_blendv_pd(_mm256_loadu_pd(b + i), _mm256_loadu_pd(a + i), m));
+  }
+  SelectF64Scalar(mask + i, a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void SelectS64Avx2(const int64_t* mask, const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i));
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_blendv_epi8(y, x, m));
+  }
+  SelectS64Scalar(mask + i, a + i, b + i, out + i, n - i);
+}
+
+#endif
+
+struct Kernels
+{
+  const char* isa;
+  void (*addF64)(const double*, const double*, double*, size_t);
+  void (*mulF64)(const double*, const double*, double*, size_t);
+  void (*scaleF64)(const double*, double, double*, size_t);
+  double (*sumF64)(const double*, size_t);
+  double (*dotF64)(const double*, const double*, size_t);
+  double (*minF64)(const double*, size_t);
+  double (*maxF64)(const double*, size_t);
+  void (*addS64)(const int64_t*, const int64_t*, int64_t*, size_t);
+  int64_t (*sumS64)(const int64_t*, size_t);
+  int64_t (*minS64)(const int64_t*, size_t);
+  int64_t (*maxS64)(const int64_t*, size_t);
+  void (*subF64)(const double*, const double*, double*, size_t);
+  void (*divF64)(const double*, const double*, double*, size_t);
+  void (*subS64)(const int64_t*, const int64_t*, int64_t*, size_t);
+  void (*lessF64)(const double*, const double*, int64_t*, size_t);
+  void (*lessEqualF64)(const double*, const double*, int64_t*, size_t);
+  void (*lessS64)(const int64_t*, const int64_t*, int64_t*, size_t);
+  void (*lessEqualS64)(const int64_t*, const int64_t*, int64_t*, size_t);
+  void (*andMask)(const int64_t*, const int64_t*, int64_t*, size_t);
+  void (*selectF64)(const int64_t*, const double*, const double*, double*, size_t);
+  void (*selectS64)(const int64_t*, const int64_t*, const int64_t*, int64_t*, size_t);
+};
+
+Kernels Select()
+{
+#ifdef MU_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    Kernels k = { "avx2", AddF64Avx2, MulF64Avx2, ScaleF64Avx2, SumF64Avx2, DotF64Avx2, MinF64Avx2,
+                  MaxF64Avx2, AddS64Avx2, SumS64Avx2, MinS64Avx2, MaxS64Avx2,
+                  SubF64Avx2, DivF64Avx2, SubS64Avx2, LessF64Avx2, LessEqualF64Avx2, LessS64Avx2,
+                  LessEqualS64Avx2, AndMaskAvx2, SelectF64Avx2, SelectS64Avx2 };
+    return k;
+  }
+  if (__builtin_cpu_supports("sse2"))
+  {
+    Kernels k = { "sse2", AddF64Sse2, MulF64Sse2, ScaleF64Sse2, SumF64Sse2, DotF64Sse2, MinF64Sse2,
+                  MaxF64Sse2, AddS64Sse2, SumS64Sse2, MinS64Scalar, MaxS64Scalar,
+                  SubF64Sse2, DivF64Sse2, SubS64Sse2, LessF64Sse2, LessEqualF64Sse2, LessS64Scalar,
+                  LessEqualS64Scalar, AndMaskSse2, SelectF64Sse2, SelectS64Sse2 };
+    return k;
+  }
+#endif
+  Kernels k = { "scalar", AddF64Scalar, MulF64Scalar, ScaleF64Scalar, SumF64Scalar, DotF64Scalar, MinF64Scalar,
+                MaxF64Scalar, AddS64Scalar, SumS64Scalar, MinS64Scalar, MaxS64Scalar,
+                SubF64Scalar, DivF64Scalar, SubS64Scalar, LessF64Scalar, LessEqualF64Scalar, LessS64Scalar,
+                LessEqualS64Scalar, AndMaskScalar, SelectF64Scalar, SelectS64Scalar };
+  return k;
+}
+
+const Kernels& Active()
+{
+  static const Kernels kernels = Select();
+  return kernels;
+}
+
+}
+
+const char* simd::Isa() { return Active().isa; }
+
+void simd::AddF64(const double* a, const double* b, double* out, size_t n) { Active().addF64(a, b, out, n); }
+void simd::MulF64(const double* a, const double* b, double* out, size_t n) { Active().mulF64(a, b, out, n); }
+void simd::ScaleF64(const double* a, double k, double* out, size_t n)      { Active().scaleF64(a, k, out, n); }
+double simd::SumF64(const double* a, size_t n)                             { return Active().sumF64(a, n); }
+double simd::DotF64(const double* a, const double* b, size_t n)            { return Active().dotF64(a, b, n); }
+double simd::MinF64(const double* a, size_t n)                             { return Active().minF64(a, n); }
+double simd::MaxF64(const double* a, size_t n)                             { return Active().maxF64(a, n); }
+void simd::SubF64(const double* a, const double* b, double* out, size_t n) { Active().subF64(a, b, out, n); }
+void simd::DivF64(const double* a, const double* b, double* out, size_t n) { Active().divF64(a, b, out, n); }
+
+void simd::AddS64(const int64_t* a, const int64_t* b, int64_t* out, size_t n) { Active().addS64(a, b, out, n); }
+int64_t simd::SumS64(const int64_t* a, size_t n)                              { return Active().sumS64(a, n); }
+int64_t simd::MinS64(const int64_t* a, size_t n)                              { return Active().minS64(a, n); }
+int64_t simd::MaxS64(const int64_t* a, size_t n)                              { return Active().maxS64(a, n); }
+void simd::SubS64(const int64_t* a, const int64_t* b, int64_t* out, size_t n) { Active().subS64(a, b, out, n); }
+
+void simd::LessF64(const double* a, const double* b, int64_t* mask, size_t n)       { Active().lessF64(a, b, mask, n); }
+void simd::LessEqualF64(const double* a, const double* b, int64_t* mask, size_t n)  { Active().lessEqualF64(a, b, mask, n); }
+void simd::LessS64(const int64_t* a, const int64_t* b, int64_t* mask, size_t n)     { Active().lessS64(a, b, mask, n); }
+void simd::LessEqualS64(const int64_t* a, const int64_t* b, int64_t* mask, size_t n){ Active().lessEqualS64(a, b, mask, n); }
+void simd::AndMask(const int64_t* a, const int64_t* b, int64_t* out, size_t n)      { Active().andMask(a, b, out, n); }
+
+void simd::SelectF64(const int64_t* mask, const double* a, const double* b, double* out, size_t n)
+{
+  Active().selectF64(mask, a, b, out, n);
+}
+
+void simd::SelectS64(const int64_t* mask, const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+{
+  Active().selectS64(mask, a, b, out, n);
+}
+
+// no 64-bit lane multiply below AVX-512; these are left to the compiler
+void simd::MulS64(const int64_t* a, const int64_t* b, int64_t* out, size_t n) { MulS64Scalar(a, b, out, n); }
+void simd::ScaleS64(const int64_t* a, int64_t k, int64_t* out, size_t n)      { ScaleS64Scalar(a, k, out, n); }
+int64_t simd::DotS64(const int64_t* a, const int64_t* b, size_t n)            { return DotS64Scalar(a, b, n); }
@@ -0,0 +1,54 @@
+#ifndef __MU_SIMD_HPP__
+#define __MU_SIMD_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mu {
+namespace simd {
+
+// Kernels over packed numeric arrays. The widest instruction set the CPU
+// supports (AVX2, else SSE2, else plain C++) is picked once at run time.
+// Reductions keep eight lane accumulators folded in a fixed order in every
+// implementation, so results do not depend on which one was picked.
+
+// the instruction set the kernels use on this machine
+const char* Isa();
+
+void AddF64(const double* a, const double* b, double* out, size_t n);
+void MulF64(const double* a, const double* b, double* out, size_t n);
+void ScaleF64(const double* a, double k, double* out, size_t n);
+double SumF64(const double* a, size_t n);
+double DotF64(const double* a, const double* b, size_t n);
+double MinF64(const double* a, size_t n); // n > 0
+double MaxF64(const double* a, size_t n); // n > 0
+void SubF64(const double* a, const double* b, double* out, size_t n);
+void DivF64(const double* a, const double* b, double* out, size_t n);
+
+// int64 kernels wrap around on overflow like the elements they produce
+void AddS64(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+void MulS64(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+void ScaleS64(const int64_t* a, int64_t k, int64_t* out, size_t n);
+int64_t SumS64(const int64_t* a, size_t n);
+int64_t DotS64(const int64_t* a, const int64_t* b, size_t n);
+int64_t MinS64(const int64_t* a, size_t n); // n > 0
+int64_t MaxS64(const int64_t* a, size_t n); // n > 0
+void SubS64(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+
+// comparisons write a mask of -1 (true) or 0 (false) per element. a NaN
+// compares the way NumberCompare has it: neither less nor greater, so
+// LessEqual is true
+void LessF64(const double* a, const double* b, int64_t* mask, size_t n);
+void LessEqualF64(const double* a, const double* b, int64_t* mask, size_t n);
+void LessS64(const int64_t* a, const int64_t* b, int64_t* mask, size_t n);
+void LessEqualS64(const int64_t* a, const int64_t* b, int64_t* mask, size_t n);
+void AndMask(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+
+// out = mask ? a : b, element by element
+void SelectF64(const int64_t* mask, const double* a, const double* b, double* out, size_t n);
+void SelectS64(const int64_t* mask, const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+
+}
+}
+
+#endif
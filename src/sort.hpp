@@ -0,0 +1,36 @@
+#ifndef __MU_SORT_HPP__
+#define __MU_SORT_HPP__
+
+#include <algorithm>
+#include <thread>
+#include <stddef.h>
+
+namespace mu {
+
+// inputs shorter than this are sorted on the calling thread
+const size_t ParallelSortThreshold = 1 << 16;
+
+// Sort [begin, end) with 'less', a strict weak ordering that may be called
+// from several threads at once. Up to 'threshold' elements this is
+// std::sort, an in-place introsort; above it the range is split in half,
+// the halves are sorted on two threads, each splitting further while
+// threads remain, and merged back.
+template <class T, class Less>
+void ParallelSort(T* begin, T* end, Less less, unsigned threads = std::thread::hardware_concurrency(),
+                  size_t threshold = ParallelSortThreshold)
+{
+  if (threads < 2 || size_t(end - begin) <= threshold)
+  {
+    std::sort(begin, end, less);
+    return;
+  }
+  T* mid = begin + (end - begin) / 2;
+  std::thread half([=]() { ParallelSort(begin, mid, less, threads / 2, threshold); });
+  ParallelSort(mid, end, less, threads - threads / 2, threshold);
+  half.join();
+  std::inplace_merge(begin, mid, end, less);
+}
+
+}
+
+#endif
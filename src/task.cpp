@@ -0,0 +1,80 @@
+#include "task.hpp"
+#include "scheduler.hpp"
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace mu;
+
+thread_local Task* Task::s_current = nullptr;
+
+Task::Task(const Body& body, size_t budget, size_t stackSize)
+: m_body(body), m_done(false), m_parked(false), m_scheduler(nullptr), m_budget(budget ? budget : 1), m_steps(0),
+  m_stack(nullptr), m_stackSize(stackSize)
+{
+  // reserve the stack lazily and put an inaccessible guard page at its
+  // bottom so that running out of stack faults instead of corrupting memory
+  const size_t page = sysconf(_SC_PAGESIZE);
+  m_stackSize = (m_stackSize + page - 1) / page * page + page;
+  void* stack = mmap(nullptr, m_stackSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (stack == MAP_FAILED)
+  {
+    std::cout << "cannot allocate task stack\n";
+    exit(1);
+  }
+  m_stack = static_cast<char*>(stack);
+  mprotect(m_stack, page, PROT_NONE);
+
+  getcontext(&m_context);
+  m_context.uc_stack.ss_sp = m_stack;
+  m_context.uc_stack.ss_size = m_stackSize;
+  m_context.uc_link = &m_caller;
+  makecontext(&m_context, &Task::Entry, 0);
+}
+
+Task::~Task()
+{
+  munmap(m_stack, m_stackSize);
+}
+
+bool Task::Resume()
+{
+  if (m_done)
+    return true;
+  Task* outer = s_current;
+  s_current = this;
+  m_steps = 0;
+  swapcontext(&m_caller, &m_context);
+  s_current = outer;
+  return m_done;
+}
+
+void Task::Yield()
+{
+  m_steps = 0;
+  swapcontext(&m_context, &m_caller);
+}
+
+void Task::Park()
+{
+  m_parked = true;
+  Yield();
+}
+
+void Task::Wake()
+{
+  if (!m_parked)
+    return;
+  m_parked = false;
+  if (m_scheduler)
+    m_scheduler->Wake(this);
+}
+
+void Task::Entry()
+{
+  // Resume() has just made us current; returning follows uc_link to m_caller
+  Task* task = s_current;
+  task->m_result = task->m_body();
+  task->m_done = true;
+}
@@ -0,0 +1,105 @@
+#ifndef __MU_TASK_HPP__
+#define __MU_TASK_HPP__
+
+#include "cell.hpp"
+#include <functional>
+#include <ucontext.h>
+
+namespace mu {
+
+class Scheduler;
+
+// an evaluation running on a stack of its own so that it can be suspended
+// after a budget of eval steps and resumed later from the same thread
+class Task
+{
+public:
+  typedef std::function<Cell()> Body;
+
+  Task(const Body& body, size_t budget, size_t stackSize = 1024 * 1024);
+  ~Task();
+
+  // run until the budget is used up or the body finishes;
+  // return true once the body has finished
+  bool Resume();
+
+  bool IsDone() const
+  {
+    return m_done;
+  }
+
+  // the value of the body, valid once IsDone()
+  const Cell& GetResult() const
+  {
+    return m_result;
+  }
+
+  size_t GetBudget() const
+  {
+    return m_budget;
+  }
+
+  void SetBudget(size_t budget)
+  {
+    m_budget = budget;
+  }
+
+  // count one eval step of the running task, if any, and yield back to
+  // whoever called Resume() when its budget is exhausted
+  static void Tick()
+  {
+    Task* task = s_current;
+    if (task && ++task->m_steps >= task->m_budget)
+      task->Yield();
+  }
+
+  // the task running on this thread, or nullptr outside of any task
+  static Task* Current()
+  {
+    return s_current;
+  }
+
+  // give control back to whoever called Resume()
+  void Yield();
+
+  // yield until Wake() is called; a Scheduler does not resume parked tasks
+  void Park();
+
+  // make a parked task runnable again
+  void Wake();
+
+  bool IsParked() const
+  {
+    return m_parked;
+  }
+
+  // set by Scheduler::Add so that Wake() can requeue the task
+  void SetScheduler(Scheduler* scheduler)
+  {
+    m_scheduler = scheduler;
+  }
+
+private:
+  Task(const Task&);
+  Task& operator=(const Task&);
+
+  static void Entry();
+
+  Body m_body;
+  Cell m_result;
+  bool m_done;
+  bool m_parked;
+  Scheduler* m_scheduler;
+  size_t m_budget;
+  size_t m_steps;
+  char* m_stack;
+  size_t m_stackSize;
+  ucontext_t m_context;
+  ucontext_t m_caller;
+
+  static thread_local Task* s_current;
+};
+
+}
+
+#endif
@@ -2,8 +2,20 @@
 
 #include "catch.hpp"
 
+#include <fstream>
+#include <random>
+#include <cstring>
+
 #include "cell.hpp"
+#include "hamt.hpp"
+#include "hashtable.hpp"
 #include "interpreter.hpp"
+#include "number.hpp"
+#include "numvec.hpp"
+#include "rope.hpp"
+#include "scheduler.hpp"
+#include "simd.hpp"
+#include "sort.hpp"
 
 using namespace mu;
 
@@ -34,8 +46,8 @@ TEST_CASE("Original tests", "[interpreter]")
   REQUIRE(Eval(i, "((repeat (repeat twice)) 5)") == "80");
   REQUIRE(Eval(i, "(define fact (lambda (n) (if (<= n 1) 1 (* n (fact (- n 1))))))") == "<Lambda>");
   REQUIRE(Eval(i, "(fact 3)") == "6");
-  //REQUIRE(Eval(i, "(fact 50)") == "30414093201713378043612608166064768844377641568960512000000000000");
-  REQUIRE(Eval(i, "(fact 12)") == "479001600"); // no bignums; this is as far as we go with 32 bits
+  REQUIRE(Eval(i, "(fact 50)") == "30414093201713378043612608166064768844377641568960512000000000000");
+  REQUIRE(Eval(i, "(fact 12)") == "479001600");
   REQUIRE(Eval(i, "(define abs (lambda (n) ((if (> n 0) + -) 0 n)))") == "<Lambda>");
   REQUIRE(Eval(i, "(list (abs -3) (abs 0) (abs 3))") == "(3 0 3)");
   REQUIRE(Eval(i, "(define combine (lambda (f)"
@@ -82,8 +94,723 @@ TEST_CASE("Define repeat and apply", "[interpreter]")
   REQUIRE(Eval(i, "((repeat twice) 5)") == "20");
 }
 
+TEST_CASE("Constant folding", "[optimizer]")
+{
+  Interpreter i;
+  i.Eval("(define f (lambda () (+ (* 2 100) (* 1 10))))");
+  REQUIRE(i.Eval("f").GetList()[2].GetType() == Guarded);
+  REQUIRE(Eval(i, "(f)") == "210");
+  REQUIRE(Eval(i, "(if (< 1 2) (quote yes) (quote no))") == "yes");
+  REQUIRE(Eval(i, "(begin 1 (car (quote (2 3))) (length (quote (4 5))))") == "2");
+  REQUIRE(Eval(i, "(quote (+ 1 2))") == "(+ 1 2)");
+  // a name bound in the code is not the primitive
+  REQUIRE(Eval(i, "((lambda (+) (+ 1 2)) -)") == "-1");
+  // errors are left for evaluation to report
+  REQUIRE(Eval(i, "(define g (lambda () (/ 6 0)))") == "<Lambda>");
+
+  // rebinding a primitive sends folded code back to the original
+  i.Eval("(define * (lambda (a b) (+ a b)))");
+  REQUIRE(Eval(i, "(f)") == "113");
+}
+
+TEST_CASE("Sealed globals", "[optimizer]")
+{
+  Interpreter i;
+  i.Eval("(define scale 3)");
+  i.Eval("(define triple (lambda (x) (* scale x)))");
+  REQUIRE(i.Eval("triple").GetList()[2].ListAt(1).GetType() == Guarded);
+  REQUIRE(Eval(i, "(triple 5)") == "15");
+  REQUIRE(Eval(i, "(set! scale 4)") == "4");
+  REQUIRE(Eval(i, "(triple 5)") == "20");
+  // once reassigned, a global is looked up again
+  i.Eval("(define quad (lambda (x) (* scale x)))");
+  REQUIRE(i.Eval("quad").GetList()[2].ListAt(1).GetType() == Symbol);
+
+  i.Eval("(define sq (lambda (x) (* x x)))");
+  i.Eval("(define f4 (lambda (x) (sq (sq x))))");
+  REQUIRE(Eval(i, "(f4 2)") == "16");
+  i.Eval("(define sq (lambda (x) (+ x x)))");
+  REQUIRE(Eval(i, "(f4 2)") == "8");
+
+  // not yet defined when the code was read
+  i.Eval("(define g (lambda () later))");
+  i.Eval("(define later 7)");
+  REQUIRE(Eval(i, "(g)") == "7");
+}
+
+TEST_CASE("Inlining small lambdas", "[optimizer]")
+{
+  Interpreter i;
+  i.Eval("(define twice (lambda (x) (* 2 x)))");
+  i.Eval("(define h (lambda (y) (twice y)))");
+  REQUIRE(i.Eval("h").GetList()[2].GetType() == Guarded);
+  REQUIRE(Eval(i, "(h 5)") == "10");
+  // inlined, then folded
+  i.Eval("(define k (lambda () (twice 21)))");
+  Cell body(i.Eval("k").GetList()[2]);
+  REQUIRE(body.GetType() == Guarded);
+  REQUIRE(body.ToString() == "42");
+  REQUIRE(Eval(i, "(k)") == "42");
+
+  // the parameters of the inlined body do not clash with the caller's
+  i.Eval("(define sub1 (lambda (x) (- x 1)))");
+  i.Eval("(define t (lambda (x) (sub1 (sub1 x))))");
+  REQUIRE(Eval(i, "(t 5)") == "3");
+
+  // an argument used more than once is not evaluated more than once
+  i.Eval("(define abs1 (lambda (x) (if (< x 0) (- 0 x) x)))");
+  i.Eval("(define m (lambda (y) (abs1 (- y 10))))");
+  REQUIRE(i.Eval("m").GetList()[2].GetType() == List);
+  REQUIRE(Eval(i, "(m 3)") == "7");
+
+  // the callee's free names keep their global meaning
+  i.Eval("(define k2 100)");
+  i.Eval("(define addk (lambda (x) (+ x k2)))");
+  i.Eval("(define s (lambda (k2) (addk k2)))");
+  REQUIRE(Eval(i, "(s 1)") == "101");
+
+  // recursive lambdas are called, not expanded
+  i.Eval("(define down (lambda (n) (if (< n 1) 0 (down (- n 1)))))");
+  REQUIRE(Eval(i, "(down 10)") == "0");
+
+  i.Eval("(define twice (lambda (x) (+ x x x)))");
+  REQUIRE(Eval(i, "(h 5)") == "15");
+  REQUIRE(Eval(i, "(k)") == "63");
+}
+
+TEST_CASE("Lifting inner lambdas", "[optimizer]")
+{
+  Interpreter i;
+  i.Eval("(define halves (lambda (deck) (begin"
+         "(define take (lambda (n seq) (if (<= n 0) (quote ()) (cons (car seq) (take (- n 1) (cdr seq))))))"
+         "(define mid (lambda (seq) (/ (length seq) 2)))"
+         "(list (take (mid deck) deck) (mid deck)))))");
+  // the helpers are made once, not on every call
+  REQUIRE(i.Eval("halves").GetList()[2].ToString().find("define") == std::string::npos);
+  REQUIRE(Eval(i, "(halves (list 1 2 3 4))") == "((1 2) 2)");
+  REQUIRE(Eval(i, "(halves (list 5 6 7 8 9 10))") == "((5 6 7) 3)");
+
+  // a helper using the call's variables stays a closure
+  i.Eval("(define add-all (lambda (k xs) (begin (define add (lambda (x) (+ x k))) (map add xs))))");
+  REQUIRE(i.Eval("add-all").GetList()[2].ToString().find("define") != std::string::npos);
+  REQUIRE(Eval(i, "(add-all 10 (list 1 2))") == "(11 12)");
+  REQUIRE(Eval(i, "(add-all 20 (list 1 2))") == "(21 22)");
+
+  // and so does one that calls it
+  i.Eval("(define add-twice (lambda (k x) (begin (define add (lambda (y) (+ y k))) (define both (lambda (y) (add (add y)))) (both x))))");
+  REQUIRE(Eval(i, "(add-twice 3 1)") == "7");
+}
+
 TEST_CASE("Parse some string", "[strings]")
 {
   Interpreter i;
   REQUIRE(Eval(i, "(define myStr \"some string\")") == "some string");
 }
+
+TEST_CASE("Strings built from ropes", "[strings]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(string-append \"ab\" \"cd\" \"\")") == "abcd");
+  REQUIRE(Eval(i, "(substring \"hello world\" 6)") == "world");
+  REQUIRE(Eval(i, "(substring \"hello world\" 0 5)") == "hello");
+  REQUIRE(Eval(i, "(string-length \"hello\")") == "5");
+
+  // short literals live in the Cell, long ones are shared
+  REQUIRE(i.Eval("\"fifteen bytes..\"").GetObject<Rope>() == nullptr);
+  Cell a(i.Eval("\"a literal repeated across the script\""));
+  Cell b(i.Eval("(car (list \"a literal repeated across the script\"))"));
+  REQUIRE(a.GetObject<Rope>() != nullptr);
+  REQUIRE(a.GetObject<Rope>() == b.GetObject<Rope>());
+  REQUIRE(b.GetVal() == "a literal repeated across the script");
+  REQUIRE(Eval(i, "(substring \"a literal repeated across the script\" 2 9)") == "literal");
+
+  // repeated appends stay balanced, and slices agree with std::string
+  Eval(i, "(define build (lambda (s n) (if (< n 1) s (build (string-append s \"line \" \"0123456789;\") (- n 1)))))");
+  Cell s(i.Eval("(define report (build \"\" 1000))"));
+  REQUIRE(s.GetType() == String);
+  REQUIRE(s.GetObject<Rope>()->Depth() < 10);
+  std::string expected;
+  for (int k = 0; k < 1000; ++k)
+    expected += "line 0123456789;";
+  REQUIRE(Eval(i, "(string-length report)") == std::to_string(expected.size()));
+  REQUIRE(s.GetVal() == expected);
+  REQUIRE(Eval(i, "(substring report 5 15)") == "0123456789");
+  REQUIRE(i.Eval("(substring report 3 9000)").GetVal() == expected.substr(3, 8997));
+  REQUIRE(i.Eval("(string-append (substring report 100) (substring report 0 100))").GetVal() ==
+          expected.substr(100) + expected.substr(0, 100));
+}
+
+TEST_CASE("Spawn and touch", "[concurrency]")
+{
+  Interpreter i;
+  i.Eval("(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))");
+  REQUIRE(Eval(i, "(define f (spawn (fib 15)))") == "<Future>");
+  REQUIRE(Eval(i, "(+ (touch f) (fib 15))") == "1220");
+  REQUIRE(Eval(i, "(define a (spawn (fib 14)))") == "<Future>");
+  REQUIRE(Eval(i, "(define b (spawn (fib 14)))") == "<Future>");
+  REQUIRE(Eval(i, "(+ (touch a) (touch b))") == "754");
+  REQUIRE(Eval(i, "(touch (spawn (begin (define y 5) (* y y))))") == "25");
+  REQUIRE(Eval(i, "(touch (spawn (touch (spawn (list 1 2)))))") == "(1 2)");
+  REQUIRE(Eval(i, "(touch 3)") == "3");
+}
+
+TEST_CASE("Cooperative tasks yield and resume", "[tasks]")
+{
+  Interpreter i;
+  i.Eval("(define fact (lambda (n) (if (<= n 1) 1 (* n (fact (- n 1))))))");
+  std::shared_ptr<Task> t = i.Start("(begin (define n 10) (fact n))", 20);
+  int resumes = 1;
+  while (!t->Resume())
+    ++resumes;
+  REQUIRE(resumes > 1);
+  REQUIRE(t->GetResult().ToString() == "3628800");
+
+  Scheduler s;
+  std::vector<std::shared_ptr<Task> > tasks;
+  for (int n = 1; n <= 100; ++n)
+  {
+    tasks.push_back(i.Start("(fact " + std::to_string(n % 12 + 1) + ")", 7));
+    s.Add(tasks.back());
+  }
+  s.Run();
+  REQUIRE(s.IsEmpty());
+  REQUIRE(tasks[0]->GetResult().ToString() == "2");
+  REQUIRE(tasks[10]->GetResult().ToString() == "479001600");
+  REQUIRE(tasks[99]->GetResult().ToString() == "120");
+}
+
+TEST_CASE("Asynchronous primitives park only the calling task", "[tasks]")
+{
+  Interpreter i;
+  i.Eval("(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))");
+  REQUIRE(Eval(i, "(begin (sleep 1) 7)") == "7");
+
+  Scheduler s;
+  std::shared_ptr<Task> sleeper = i.Start("(begin (sleep 50) 1)", 10);
+  std::shared_ptr<Task> worker = i.Start("(fib 10)", 10);
+  s.Add(sleeper);
+  s.Add(worker);
+  bool overlapped = false;
+  while (s.RunOnce())
+    overlapped = overlapped || (worker->IsDone() && !sleeper->IsDone());
+  REQUIRE(overlapped);
+  REQUIRE(sleeper->GetResult().ToString() == "1");
+  REQUIRE(worker->GetResult().ToString() == "55");
+
+  std::ofstream("mu_read_file_test.txt") << "file contents";
+  REQUIRE(Eval(i, "(read-file \"mu_read_file_test.txt\")") == "file contents");
+  std::shared_ptr<Task> reader = i.Start("(list (read-file \"mu_read_file_test.txt\"))", 10);
+  s.Add(reader);
+  s.Run();
+  REQUIRE(reader->GetResult().ToString() == "(file contents)");
+  std::remove("mu_read_file_test.txt");
+  REQUIRE(Eval(i, "(read-file \"mu_no_such_file.txt\")") == "#f");
+}
+
+static Cell proc_answer(const Cells &)
+{
+  return Cell(Number, "42");
+}
+
+TEST_CASE("Host functions carrying state", "[native]")
+{
+  Interpreter i;
+  long calls = 0;
+  i.Define("answer", &proc_answer);
+  i.Define("count!", 0, [&calls](const Cells &) {
+    return Cell(Number, std::to_string(++calls));
+  });
+  std::map<std::string, std::string> cache;
+  i.Define("remember", {String, String}, [&cache](const Cells & c) {
+    return Cell(String, cache[c[0].GetVal()] = c[1].GetVal());
+  });
+  i.Define("count-args", Signature::Variadic(1), [](const Cells & c) {
+    return Cell(Number, std::to_string(c.size()));
+  });
+  REQUIRE(Eval(i, "(answer)") == "42");
+  REQUIRE(Eval(i, "(list (count!) (count!) (count!))") == "(1 2 3)");
+  REQUIRE(calls == 3);
+  REQUIRE(Eval(i, "((lambda (f) (f)) count!)") == "4");
+  REQUIRE(Eval(i, "(remember \"k\" \"v\")") == "v");
+  REQUIRE(cache["k"] == "v");
+  REQUIRE(Eval(i, "(count-args 1 2 3)") == "3");
+  REQUIRE(Eval(i, "(+ 1 2)") == "3");
+}
+
+static Cell proc_clamp(const Cell & x, const Cell & lo, const Cell & hi)
+{
+  return MakeFixnum(std::max(lo.GetFixnum(), std::min(x.GetFixnum(), hi.GetFixnum())));
+}
+
+TEST_CASE("Fixed arity primitives", "[native]")
+{
+  Interpreter i;
+  i.Define("clamp", Cell(&proc_clamp));
+  REQUIRE(Eval(i, "(clamp 5 0 3)") == "3");
+  REQUIRE(Eval(i, "(clamp (- 0 5) 0 3)") == "0");
+  REQUIRE(Eval(i, "(+ 1 2)") == "3");
+  REQUIRE(Eval(i, "(+ 1 2 3 4)") == "10");
+  REQUIRE(Eval(i, "(- 10 1 2)") == "7");
+  REQUIRE(Eval(i, "(< 1 2 3)") == "#t");
+  REQUIRE(Eval(i, "(< 3 1 2)") == "#f");
+  REQUIRE(Eval(i, "(car (cdr (list 1 2 3)))") == "2");
+  REQUIRE(Eval(i, "((lambda (op) (op 6 7)) *)") == "42");
+}
+
+TEST_CASE("Fixnums promote to bignums on overflow", "[numbers]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(+ 9223372036854775807 1)") == "9223372036854775808");
+  REQUIRE(Eval(i, "(- (- 0 9223372036854775807) 2)") == "-9223372036854775809");
+  REQUIRE(Eval(i, "(* 4294967296 4294967296)") == "18446744073709551616");
+  REQUIRE(Eval(i, "(- (+ 9223372036854775807 1) 1)") == "9223372036854775807");
+  REQUIRE(Eval(i, "(/ 100000000000000000000000000000 10000000000000000000)") == "10000000000");
+  REQUIRE(Eval(i, "(< 99999999999999999999 100000000000000000000)") == "#t");
+  REQUIRE(Eval(i, "(> (- 0 99999999999999999999) 1)") == "#f");
+  REQUIRE(Eval(i, "(/ (- 0 7) 2)") == "-3");
+  i.Eval("(define fact (lambda (n) (if (<= n 1) 1 (* n (fact (- n 1))))))");
+  REQUIRE(Eval(i, "(fact 30)") == "265252859812191058636308480000000");
+  // operands of several hundred limbs go through Karatsuba
+  REQUIRE(Eval(i, "(- (/ (* (fact 600) (fact 601)) (fact 601)) (fact 600))") == "0");
+  REQUIRE(Eval(i, "(/ (fact 700) (fact 699))") == "700");
+}
+
+TEST_CASE("Real numbers", "[numbers]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(quote (2.0 -3.14e159 1e-5 0.1))") == "(2.0 -3.14e159 1e-5 0.1)");
+  REQUIRE(Eval(i, "(+ 1.5 2)") == "3.5");
+  REQUIRE(Eval(i, "(+ 0.1 0.2)") == "0.30000000000000004");
+  REQUIRE(Eval(i, "(/ 1.0 3)") == "0.3333333333333333");
+  REQUIRE(Eval(i, "(/ 7 2)") == "3");
+  REQUIRE(Eval(i, "(* 2.5 100000000000000000000)") == "2.5e20");
+  REQUIRE(Eval(i, "(* 1e200 1e200)") == "+inf.0");
+  REQUIRE(Eval(i, "(- 0 0.0)") == "0.0");
+  REQUIRE(Eval(i, "(< 1 1.5 2)") == "#t");
+  REQUIRE(Eval(i, "(list 5e-324 1.7976931348623157e308 123456.789)") == "(5e-324 1.7976931348623157e308 123456.789)");
+}
+
+TEST_CASE("Real parsing is exact and printing round trips", "[numbers]")
+{
+  std::mt19937_64 rng(7);
+  for (int n = 0; n < 20000; ++n)
+  {
+    uint64_t bits = rng();
+    double x;
+    std::memcpy(&x, &bits, sizeof(x));
+    if (x != x || x - x != 0)
+      continue; // nan or inf
+    std::string text(FormatReal(x));
+    double y;
+    REQUIRE(ParseReal(text.data(), text.data() + text.size(), y));
+    REQUIRE(std::memcmp(&x, &y, sizeof(x)) == 0);
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*e", int(rng() % 20), x);
+    REQUIRE(ParseReal(buf, buf + strlen(buf), y));
+    REQUIRE(y == strtod(buf, nullptr));
+  }
+}
+
+TEST_CASE("Lists of numbers stay unboxed", "[lists]")
+{
+  Interpreter i;
+  Cell ints(i.Eval("(define a (list 1 2 3))"));
+  REQUIRE(ints.GetListStore()->GetStrategy() == ListStore::Ints);
+  REQUIRE(i.Eval("(cdr a)").GetListStore()->GetStrategy() == ListStore::Ints);
+  REQUIRE(i.Eval("(append a (list 4 5))").GetListStore()->GetStrategy() == ListStore::Ints);
+  REQUIRE(i.Eval("(list 1.5 2.5)").GetListStore()->GetStrategy() == ListStore::Reals);
+  REQUIRE(i.Eval("(quote (1 2 3))").GetListStore()->GetStrategy() == ListStore::Ints);
+
+  // the first element of another kind boxes the list
+  Cell mixed(i.Eval("(cons \"x\" a)"));
+  REQUIRE(mixed.GetListStore()->GetStrategy() == ListStore::Boxed);
+  REQUIRE(mixed.ToString() == "(x 1 2 3)");
+  REQUIRE(i.Eval("(append a (list 0.5))").GetListStore()->GetStrategy() == ListStore::Boxed);
+  REQUIRE(Eval(i, "(append a (list 0.5))") == "(1 2 3 0.5)");
+  REQUIRE(Eval(i, "(cons 99999999999999999999 a)") == "(99999999999999999999 1 2 3)");
+
+  // ... without touching the list it was made from
+  REQUIRE(ints.GetListStore()->GetStrategy() == ListStore::Ints);
+  REQUIRE(Eval(i, "a") == "(1 2 3)");
+  REQUIRE(Eval(i, "(list (car a) (length a) (null? a) (null? (list)) (cdr (list 1)))") == "(1 3 #f #t nil)");
+  REQUIRE(ints.GetList().size() == 3);
+  REQUIRE(ints.GetList()[2].GetFixnum() == 3);
+  REQUIRE(ints.GetListStore()->GetStrategy() == ListStore::Ints);
+  ints.GetMutableList().push_back(Cell(String, "y"));
+  REQUIRE(ints.ToString() == "(1 2 3 y)");
+  REQUIRE(Eval(i, "a") == "(1 2 3)");
+
+  REQUIRE(Eval(i, "(s64vector->list (list->s64vector (list 4 5 6)))") == "(4 5 6)");
+  REQUIRE(i.Eval("(f64vector->list (f64vector 1 2))").GetListStore()->GetStrategy() == ListStore::Reals);
+}
+
+TEST_CASE("Hash-consed lists", "[lists]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(equal? (list 1 (list 2 (quote x))) (list 1 (list 2 (quote x))))") == "#t");
+  REQUIRE(Eval(i, "(equal? (list 1 2) (list 1 2.0))") == "#f");
+  REQUIRE(Eval(i, "(equal? \"ab\" (string-append \"a\" \"b\"))") == "#t");
+  REQUIRE(i.Eval("(quote (a b))").GetListStore() != i.Eval("(quote (a b))").GetListStore());
+
+  REQUIRE(Eval(i, "(hash-consing #t)") == "#f");
+  Cell a(i.Eval("(quote (a (b c) 1 2.5))"));
+  Cell b(i.Eval("(cons (quote a) (list (list (quote b) (quote c)) 1 2.5))"));
+  REQUIRE(a.GetListStore() == b.GetListStore());
+  REQUIRE(a.GetListStore()->IsInterned());
+  REQUIRE(i.Eval("(cdr (quote (0 1 2)))").GetListStore() == i.Eval("(quote (1 2))").GetListStore());
+  REQUIRE(Eval(i, "(equal? (quote (a (b c) 1 2.5)) (append (quote (a)) (quote ((b c) 1 2.5))))") == "#t");
+  REQUIRE(Eval(i, "(equal? (quote (1 2)) (quote (1 2 3)))") == "#f");
+  // changing a shared list copies it first
+  b.PushBack(MakeFixnum(3));
+  REQUIRE(a.ToString() == "(a (b c) 1 2.5)");
+  REQUIRE(b.ToString() == "(a (b c) 1 2.5 3)");
+  // lists holding procedures are left as they are
+  REQUIRE(Eval(i, "((car (list car 1)) (quote (5)))") == "5");
+  REQUIRE(Eval(i, "(hash-consing #f)") == "#t");
+}
+
+TEST_CASE("Higher-order list primitives", "[lists]")
+{
+  Interpreter i;
+  Eval(i, "(define xs (list 1 2 3 4 5))");
+  REQUIRE(Eval(i, "(map (lambda (x) (* x x)) xs)") == "(1 4 9 16 25)");
+  REQUIRE(i.Eval("(map (lambda (x) (* x x)) xs)").GetListStore()->GetStrategy() == ListStore::Ints);
+  REQUIRE(Eval(i, "(map + xs (list 10 20 30))") == "(11 22 33)");
+  REQUIRE(Eval(i, "(map car (list (list 1 2) (list 3)))") == "(1 3)");
+  REQUIRE(Eval(i, "(filter (lambda (x) (> x 2)) xs)") == "(3 4 5)");
+  REQUIRE(Eval(i, "(filter (lambda (x) x) (list 1 #f 2))") == "(1 2)");
+  REQUIRE(Eval(i, "(fold + 0 xs)") == "15");
+  REQUIRE(Eval(i, "(fold cons (quote ()) xs)") == "(5 4 3 2 1)");
+  REQUIRE(Eval(i, "(fold (lambda (x acc) (cons x acc)) (list) (list 1 2 3))") == "(3 2 1)");
+  REQUIRE(Eval(i, "(begin (define total 0) (for-each (lambda (x) (set! total (+ total x))) xs) total)") == "15");
+  REQUIRE(Eval(i, "(apply + xs)") == "15");
+  REQUIRE(Eval(i, "(apply list 0 xs)") == "(0 1 2 3 4 5)");
+  REQUIRE(Eval(i, "(map (lambda (x) x) (list))") == "()");
+
+  // closures made by the body keep their own bindings
+  Eval(i, "(define adders (map (lambda (n) (lambda (x) (+ x n))) xs))");
+  REQUIRE(Eval(i, "(map (lambda (f) (f 100)) adders)") == "(101 102 103 104 105)");
+  // nested and recursive uses of the same lambda
+  Eval(i, "(define sq (lambda (l) (map (lambda (x) (* x x)) l)))");
+  REQUIRE(Eval(i, "(map sq (list (list 1 2) (list 3)))") == "((1 4) (9))");
+  Eval(i, "(define depth (lambda (t) (if (< (length t) 1) 0 (+ 1 (fold (lambda (x m) (if (> x m) x m)) 0 (map depth t))))))");
+  REQUIRE(Eval(i, "(depth (list (list (list)) (list)))") == "2");
+}
+
+TEST_CASE("Fused list pipelines", "[lists]")
+{
+  Interpreter i;
+  Eval(i, "(define xs (list 1 2 3 4 5 6))");
+  REQUIRE(Eval(i, "(map (lambda (x) (* x 10)) (filter (lambda (x) (> x 2)) (map (lambda (x) (+ x 1)) xs)))") == "(30 40 50 60 70)");
+  REQUIRE(Eval(i, "(fold + 0 (map (lambda (x) (* x x)) (filter (lambda (x) (< x 4)) xs)))") == "14");
+  REQUIRE(Eval(i, "(filter (lambda (x) (> x 3)) (map (lambda (x) (* 2 x)) xs))") == "(4 6 8 10 12)");
+  REQUIRE(Eval(i, "(begin (define n 0) (for-each (lambda (x) (set! n (+ n x))) (map (lambda (x) (* 2 x)) xs)) n)") == "42");
+  REQUIRE(Eval(i, "(map list (filter (lambda (x) #f) xs))") == "()");
+
+  // the stages are called element by element
+  Eval(i, "(define trace (list))");
+  Eval(i, "(define note (lambda (tag x) (begin (set! trace (cons tag trace)) x)))");
+  REQUIRE(Eval(i, "(map (lambda (x) (note 2 x)) (map (lambda (x) (note 1 x)) (list 7 8)))") == "(7 8)");
+  REQUIRE(Eval(i, "trace") == "(2 1 2 1)");
+
+  // only the builtins fuse; a redefinition is called as it is
+  Eval(i, "(define filter (lambda (p l) (list 0)))");
+  REQUIRE(Eval(i, "(map (lambda (x) (+ x 1)) (filter (lambda (x) #t) xs))") == "(1)");
+}
+
+TEST_CASE("Promises and lazy streams", "[streams]")
+{
+  Interpreter i;
+  Eval(i, "(define calls 0)");
+  Eval(i, "(define p (delay (begin (set! calls (+ calls 1)) (* 6 7))))");
+  REQUIRE(Eval(i, "p") == "<Promise>");
+  REQUIRE(Eval(i, "calls") == "0");
+  REQUIRE(Eval(i, "(list (force p) (force p) calls)") == "(42 42 1)");
+  REQUIRE(Eval(i, "(force 5)") == "5");
+
+  // an infinite stream, computed only as far as it is read
+  Eval(i, "(define seen 0)");
+  Eval(i, "(define ints (lambda (n) (stream-cons (begin (set! seen n) n) (ints (+ n 1)))))");
+  Eval(i, "(define squares (stream-map (lambda (x) (* x x)) (ints 0)))");
+  REQUIRE(Eval(i, "(stream-take 3 (stream-filter (lambda (x) (> x 10)) squares))") == "(16 25 36)");
+  REQUIRE(Eval(i, "seen") == "6");
+  REQUIRE(Eval(i, "(stream-take 3 squares)") == "(0 1 4)");
+  REQUIRE(Eval(i, "seen") == "6");
+  REQUIRE(Eval(i, "(stream-car (stream-cdr (stream-cdr squares)))") == "4");
+  REQUIRE(Eval(i, "(stream-take 5 (stream-cons 1 (stream-cons 2 stream-nil)))") == "(1 2)");
+  REQUIRE(Eval(i, "(stream-null? (stream-filter (lambda (x) #f) (stream-cons 1 stream-nil)))") == "#t");
+  REQUIRE(Eval(i, "(stream-take 2 (stream-filter (lambda (x) (> x 50000)) (ints 0)))") == "(50001 50002)");
+}
+
+TEST_CASE("Sorting lists", "[sort]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(sort (list 3 1 2 5 4) <)") == "(1 2 3 4 5)");
+  REQUIRE(Eval(i, "(sort (list 3 1 2 5 4) >)") == "(5 4 3 2 1)");
+  REQUIRE(i.Eval("(sort (list 3 1 2) <)").GetListStore()->GetStrategy() == ListStore::Ints);
+  REQUIRE(Eval(i, "(sort (list 2.5 (/ 0.0 0.0) -1.0 0.5) <)") == "(-1.0 0.5 2.5 +nan.0)");
+  REQUIRE(Eval(i, "(sort (list 2 0.5 99999999999999999999 -3) <)") == "(-3 0.5 2 99999999999999999999)");
+  REQUIRE(Eval(i, "(sort (list) <)") == "()");
+  // any other comparison is called for each pair, and the sort is stable
+  REQUIRE(Eval(i, "(sort (list (list 2 1) (list 1 2) (list 2 3) (list 1 4)) (lambda (a b) (< (car a) (car b))))")
+          == "((1 2) (1 4) (2 1) (2 3))");
+  Eval(i, "(define <= (lambda (a b) (< b a)))");
+  REQUIRE(Eval(i, "(sort (list 1 3 2) <=)") == "(3 2 1)");
+
+  // the parallel merge sort agrees with std::sort
+  std::mt19937_64 rng(3);
+  std::vector<int64_t> data(200000);
+  for (size_t k = 0; k < data.size(); ++k)
+    data[k] = int64_t(rng() % 1000);
+  std::vector<int64_t> expected(data);
+  std::sort(expected.begin(), expected.end());
+  ParallelSort(data.data(), data.data() + data.size(), std::less<int64_t>(), 4, 1000);
+  REQUIRE(data == expected);
+
+  std::string numbers("(list");
+  for (int k = 0; k < 100000; ++k)
+    numbers += " " + std::to_string(int(rng() % 100000) - 50000);
+  Eval(i, "(define big (sort " + numbers + ") <))");
+  REQUIRE(Eval(i, "(length big)") == "100000");
+  REQUIRE(Eval(i, "(fold (lambda (x acc) (if (> (car acc) x) (list x #f) (list x (car (cdr acc))))) (list -50001 #t) big)") == "(" + Eval(i, "(car (sort big >))") + " #t)");
+}
+
+TEST_CASE("Record types", "[records]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(define-record-type point (make-point x y) point? (x point-x set-point-x!) (y point-y) (tag point-tag))") == "point");
+  REQUIRE(Eval(i, "(define p (make-point 1 2))") == "#<point 1 2 #f>");
+  REQUIRE(Eval(i, "(list (point-x p) (point-y p) (point-tag p))") == "(1 2 #f)");
+  REQUIRE(Eval(i, "(list (point? p) (point? (list 1 2)) (point? 3))") == "(#t #f #f)");
+  // copies share the record
+  Eval(i, "(define q p)");
+  REQUIRE(Eval(i, "(set-point-x! p 10)") == "10");
+  REQUIRE(Eval(i, "(point-x q)") == "10");
+  REQUIRE(Eval(i, "(map point-y (list (make-point 0 5) (make-point 0 6)))") == "(5 6)");
+
+  // another type with the same layout is still a different type
+  Eval(i, "(define-record-type other (make-other x y) other? (x other-x) (y other-y))");
+  REQUIRE(Eval(i, "(list (other? p) (point? (make-other 1 2)))") == "(#f #f)");
+  REQUIRE(Eval(i, "(other-y (make-other 3 4))") == "4");
+}
+
+TEST_CASE("Hash tables", "[hashtables]")
+{
+  Interpreter i;
+  Eval(i, "(define h (make-hash-table))");
+  REQUIRE(Eval(i, "h") == "<HashTable>");
+  REQUIRE(Eval(i, "(hash-set! h (quote apple) 1)") == "1");
+  Eval(i, "(hash-set! h \"apple\" 2)");
+  Eval(i, "(hash-set! h 3 (quote three))");
+  Eval(i, "(hash-set! h 3.0 (quote real))");
+  Eval(i, "(hash-set! h (list 1 (quote x)) (quote pair))");
+  Eval(i, "(hash-set! h 123456789012345678901234567890 (quote big))");
+  REQUIRE(Eval(i, "(hash-count h)") == "6");
+  // symbols and strings, and exact and real numbers, are different keys
+  REQUIRE(Eval(i, "(list (hash-ref h (quote apple)) (hash-ref h \"apple\") (hash-ref h 3) (hash-ref h 3.0))") == "(1 2 three real)");
+  REQUIRE(Eval(i, "(hash-ref h (list 1 (quote x)))") == "pair");
+  REQUIRE(Eval(i, "(hash-ref h (+ 123456789012345678901234567889 1))") == "big");
+  REQUIRE(Eval(i, "(hash-ref h (quote pear))") == "#f");
+  REQUIRE(Eval(i, "(hash-ref h (quote pear) 0)") == "0");
+  REQUIRE(Eval(i, "(hash-set! h (quote apple) 10)") == "10");
+  REQUIRE(Eval(i, "(hash-ref h (quote apple))") == "10");
+  REQUIRE(Eval(i, "(hash-delete! h 3)") == "#t");
+  REQUIRE(Eval(i, "(hash-delete! h 3)") == "#f");
+  REQUIRE(Eval(i, "(list (hash-count h) (hash-ref h 3) (hash-ref h 3.0))") == "(5 #f real)");
+
+  // copies of the Cell share the table
+  Eval(i, "(define fill (lambda (t n) (if (< n 1) t (begin (hash-set! t n (* n n)) (fill t (- n 1))))))");
+  Eval(i, "(define g (make-hash-table 10))");
+  Eval(i, "(fill g 1000)");
+  REQUIRE(Eval(i, "(list (hash-count g) (hash-ref g 70) (hash-ref g 1000))") == "(1000 4900 1000000)");
+
+  // removals keep every other key reachable
+  HashTableData t;
+  for (int k = 0; k < 2000; ++k)
+    t.Set(MakeFixnum(k), MakeFixnum(-k));
+  for (int k = 0; k < 2000; k += 3)
+    REQUIRE(t.Erase(MakeFixnum(k)));
+  REQUIRE(t.Count() == 2000 - 667);
+  for (int k = 0; k < 2000; ++k)
+  {
+    Cell value;
+    REQUIRE(t.Get(MakeFixnum(k), value) == (k % 3 != 0));
+    if (k % 3)
+      REQUIRE(value.GetFixnum() == -k);
+  }
+}
+
+TEST_CASE("Persistent maps", "[hashtables]")
+{
+  Interpreter i;
+  Eval(i, "(define a (pmap (quote x) 1 (quote y) 2))");
+  REQUIRE(Eval(i, "a") == "<PersistentMap>");
+  Eval(i, "(define b (pmap-set a (quote z) 3))");
+  Eval(i, "(define c (pmap-delete (pmap-set b (quote x) 10) (quote y)))");
+  // every version keeps its own bindings
+  REQUIRE(Eval(i, "(list (pmap-count a) (pmap-count b) (pmap-count c))") == "(2 3 2)");
+  REQUIRE(Eval(i, "(list (pmap-ref a (quote x)) (pmap-ref a (quote z)) (pmap-ref b (quote z)))") == "(1 #f 3)");
+  REQUIRE(Eval(i, "(list (pmap-ref c (quote x)) (pmap-ref c (quote y) 0) (pmap-ref b (quote x)))") == "(10 0 1)");
+  REQUIRE(Eval(i, "(pmap-count (pmap-delete a (quote nope)))") == "2");
+  REQUIRE(Eval(i, "(pmap-count (pmap-delete (pmap-delete a (quote x)) (quote y)))") == "0");
+
+  // a map against std::map through inserts, updates and removals,
+  // keeping an old version to check it is never disturbed
+  std::mt19937_64 rng(7);
+  Hamt map, old;
+  std::map<int64_t, int64_t> expected, oldExpected;
+  for (int k = 0; k < 20000; ++k)
+  {
+    int64_t key = int64_t(rng() % 5000);
+    if (rng() % 3)
+    {
+      map = map.Set(MakeFixnum(key), MakeFixnum(k));
+      expected[key] = k;
+    }
+    else
+    {
+      map = map.Erase(MakeFixnum(key));
+      expected.erase(key);
+    }
+    if (k == 10000)
+    {
+      old = map;
+      oldExpected = expected;
+    }
+  }
+  REQUIRE(map.Count() == expected.size());
+  REQUIRE(old.Count() == oldExpected.size());
+  for (int64_t key = 0; key < 5000; ++key)
+  {
+    Cell value;
+    REQUIRE(map.Get(MakeFixnum(key), value) == (expected.count(key) == 1));
+    if (expected.count(key))
+      REQUIRE(value.GetFixnum() == expected[key]);
+    REQUIRE(old.Get(MakeFixnum(key), value) == (oldExpected.count(key) == 1));
+    if (oldExpected.count(key))
+      REQUIRE(value.GetFixnum() == oldExpected[key]);
+  }
+}
+
+TEST_CASE("Random-access vectors", "[vectors]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(make-vector 3)") == "#(#f #f #f)");
+  Eval(i, "(define v (make-vector 2 0))");
+  REQUIRE(Eval(i, "(vector-set! v 1 (quote x))") == "x");
+  REQUIRE(Eval(i, "(vector-push! v \"s\")") == "s");
+  REQUIRE(Eval(i, "(list (vector-length v) (vector-ref v 0) (vector-ref v 1))") == "(3 0 x)");
+  REQUIRE(Eval(i, "(vector->list (list->vector (list 1 2 3)))") == "(1 2 3)");
+  REQUIRE(Eval(i, "(vector 1 (list 2 3))") == "#(1 (2 3))");
+
+  // copies share the vector, and indexing does not walk it
+  Eval(i, "(define w (vector))");
+  Eval(i, "(define fill (lambda (n) (if (< n 1) w (begin (vector-push! w n) (fill (- n 1))))))");
+  Eval(i, "(fill 1000)");
+  Eval(i, "(define sum (lambda (k acc) (if (< k 0) acc (sum (- k 1) (+ acc (vector-ref w k))))))");
+  REQUIRE(Eval(i, "(list (vector-length w) (vector-ref w 0) (vector-ref w 999) (sum 999 0))") == "(1000 1000 1 500500)");
+}
+
+TEST_CASE("Packed numeric vectors", "[vectors]")
+{
+  Interpreter i;
+  REQUIRE(Eval(i, "(f64vector 1 2.5 3)") == "#f64(1.0 2.5 3.0)");
+  REQUIRE(Eval(i, "(define a (list->f64vector (list 1 2 3 4 5 6 7 8 9 10 11)))") == "#f64(1.0 2.0 3.0 4.0 5.0 6.0 7.0 8.0 9.0 10.0 11.0)");
+  REQUIRE(Eval(i, "(f64vector-sum a)") == "66.0");
+  REQUIRE(Eval(i, "(f64vector-dot a a)") == "506.0");
+  REQUIRE(Eval(i, "(f64vector->list (f64vector-add (f64vector 1 2 3) (f64vector 0.5 0.5 0.5)))") == "(1.5 2.5 3.5)");
+  REQUIRE(Eval(i, "(f64vector-mul (f64vector 1 2 3) (f64vector 2 2 2))") == "#f64(2.0 4.0 6.0)");
+  REQUIRE(Eval(i, "(f64vector-scale (f64vector 1 -2) 1.5)") == "#f64(1.5 -3.0)");
+  REQUIRE(Eval(i, "(list (f64vector-min a) (f64vector-max a) (f64vector-length a) (f64vector-ref a 3))") == "(1.0 11.0 11 4.0)");
+  REQUIRE(Eval(i, "(f64vector-sum (make-f64vector 1000000 0.5))") == "500000.0");
+
+  REQUIRE(Eval(i, "(define b (list->s64vector (list 5 -3 9 0 2 7 -8 1 4)))") == "#s64(5 -3 9 0 2 7 -8 1 4)");
+  REQUIRE(Eval(i, "(list (s64vector-sum b) (s64vector-min b) (s64vector-max b) (s64vector-dot b b))") == "(17 -8 9 249)");
+  REQUIRE(Eval(i, "(s64vector-add b (s64vector-scale b 2))") == "#s64(15 -9 27 0 6 21 -24 3 12)");
+  // reductions stay exact where the int64 lanes would overflow
+  REQUIRE(Eval(i, "(s64vector-sum (make-s64vector 4 9223372036854775807))") == "36893488147419103228");
+  REQUIRE(Eval(i, "(s64vector-dot (s64vector 4294967296 1) (s64vector 4294967296 1))") == "18446744073709551617");
+}
+
+TEST_CASE("Vectorized lambdas over columns", "[vmap]")
+{
+  Interpreter i;
+  Eval(i, "(define xs (f64vector -1.5 0 2 3.25 -0.0 4))");
+  Eval(i, "(define ns (s64vector -3 0 7 11 -9223372036854775807 5))");
+  REQUIRE(Eval(i, "(vmap (lambda (x) (* x 2)) xs)") == "#f64(-3.0 0.0 4.0 6.5 -0.0 8.0)");
+  REQUIRE(Eval(i, "(vmap (lambda (x) (if (< x 0) (- 0 x) x)) xs)") == "#f64(1.5 0.0 2.0 3.25 -0.0 4.0)");
+  REQUIRE(Eval(i, "(vmap (lambda (x y) (/ (+ x y 1) 2)) xs xs)") == "#f64(-1.0 0.5 2.5 3.75 0.5 4.5)");
+  REQUIRE(Eval(i, "(vmap (lambda (x) (if (< x 0 3) 1 (if (<= x 2) 2 3))) xs)") == "#f64(1.0 2.0 2.0 3.0 2.0 3.0)");
+  REQUIRE(Eval(i, "(vmap (lambda (x) (if (> 1 2) x (* 2 3))) xs)") == "#f64(6.0 6.0 6.0 6.0 6.0 6.0)");
+  REQUIRE(Eval(i, "(define k 10)") == "10");
+  REQUIRE(Eval(i, "(vmap (lambda (n) (- (* n k) 1)) (s64vector 1 2 3))") == "#s64(9 19 29)");
+  // overflow, division and reals in an s64 kernel are left to eval
+  REQUIRE(Eval(i, "(vmap (lambda (n) (* n 2)) ns)") == "#f64(-6.0 0.0 14.0 22.0 -1.8446744073709552e19 10.0)");
+  REQUIRE(Eval(i, "(vmap (lambda (n) (/ n 2)) (s64vector 7 -7))") == "#s64(3 -3)");
+  REQUIRE(Eval(i, "(vmap (lambda (n) (* n 0.5)) (s64vector 1 2))") == "#f64(0.5 1.0)");
+  REQUIRE(Eval(i, "(vmap (lambda (n m) (+ n m)) (s64vector 1 2) (f64vector 0.5 0.5))") == "#f64(1.5 2.5)");
+  REQUIRE(Eval(i, "(vmap + (s64vector 1 2) (s64vector 3 4))") == "#s64(4 6)");
+  REQUIRE(Eval(i, "(vmap (lambda (x) x) (f64vector))") == "#f64()");
+
+  // a lambda calling something the kernels do not know, or a redefined builtin
+  Eval(i, "(define twice (lambda (x) (* 2 x)))");
+  REQUIRE(Eval(i, "(vmap (lambda (x) (twice x)) xs)") == "#f64(-3.0 0.0 4.0 6.5 -0.0 8.0)");
+  Eval(i, "(define * (lambda (a b) (+ a b)))");
+  REQUIRE(Eval(i, "(vmap (lambda (x) (* x 2)) xs)") == "#f64(0.5 2.0 4.0 5.25 2.0 6.0)");
+
+  // long columns, run in batches, agree with eval row by row
+  std::mt19937_64 rng(5);
+  std::uniform_real_distribution<double> real(-100, 100);
+  std::string column("(f64vector");
+  for (int k = 0; k < 1000; ++k)
+    column += " " + FormatReal(real(rng));
+  Eval(i, "(define big " + column + "))");
+  Eval(i, "(define f (lambda (x) (if (<= x 0) (- (+ x x) 1) (/ 1 (- x 50)))))");
+  Cell v(i.Eval("(vmap f big)"));
+  const std::vector<double>& out = v.GetObject<F64Data>()->m_data;
+  REQUIRE(out.size() == 1000);
+  for (int k = 0; k < 1000; k += 37)
+  {
+    std::string ref("(f (f64vector-ref big " + std::to_string(k) + "))");
+    REQUIRE(FormatReal(out[k]) == Eval(i, ref));
+  }
+}
+
+TEST_CASE("SIMD kernels agree with plain loops", "[vectors]")
+{
+  std::mt19937_64 rng(11);
+  std::uniform_real_distribution<double> real(-1000, 1000);
+  for (size_t n = 1; n < 70; ++n)
+  {
+    std::vector<double> x(n), y(n), out(n);
+    std::vector<int64_t> p(n), q(n), pout(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+      x[k] = real(rng);
+      y[k] = real(rng);
+      p[k] = int64_t(rng() % 2000001) - 1000000;
+      q[k] = int64_t(rng() % 2000001) - 1000000;
+    }
+    double sum = 0, dot = 0;
+    int64_t psum = 0, pdot = 0;
+    for (size_t k = 0; k < n; ++k)
+    {
+      sum += x[k];
+      dot += x[k] * y[k];
+      psum += p[k];
+      pdot += p[k] * q[k];
+    }
+    REQUIRE(std::fabs(simd::SumF64(x.data(), n) - sum) < 1e-9);
+    REQUIRE(std::fabs(simd::DotF64(x.data(), y.data(), n) - dot) < 1e-6);
+    REQUIRE(simd::MinF64(x.data(), n) == *std::min_element(x.begin(), x.end()));
+    REQUIRE(simd::MaxF64(x.data(), n) == *std::max_element(x.begin(), x.end()));
+    simd::AddF64(x.data(), y.data(), out.data(), n);
+    REQUIRE(out[n - 1] == x[n - 1] + y[n - 1]);
+    REQUIRE(simd::SumS64(p.data(), n) == psum);
+    REQUIRE(simd::DotS64(p.data(), q.data(), n) == pdot);
+    REQUIRE(simd::MinS64(p.data(), n) == *std::min_element(p.begin(), p.end()));
+    REQUIRE(simd::MaxS64(p.data(), n) == *std::max_element(p.begin(), p.end()));
+    simd::AddS64(p.data(), q.data(), pout.data(), n);
+    REQUIRE(pout[0] == p[0] + q[0]);
+  }
+}
@@ -0,0 +1,553 @@
+#include "vmap.hpp"
+#include "interpreter.hpp"
+#include "native.hpp"
+#include "number.hpp"
+#include "numvec.hpp"
+#include "optimize.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <iostream>
+
+using namespace mu;
+
+namespace {
+
+// rows processed per pass over the compiled code
+const size_t Batch = 256;
+
+// the primitives a kernel can call, as they were registered; a symbol
+// only compiles to an operation while it is still bound to one of these
+struct Builtins
+{
+  explicit Builtins(Env& env)
+  : add(env["+"].GetProc2()), sub(env["-"].GetProc2()), mul(env["*"].GetProc2()),
+    div(env["/"].GetProc2()), less(env["<"].GetProc2()), greater(env[">"].GetProc2()),
+    lessEqual(env["<="].GetProc2())
+  {
+  }
+
+  Cell::Proc2Type add, sub, mul, div, less, greater, lessEqual;
+};
+
+enum Op
+{
+  Add,
+  Sub,
+  Mul,
+  Div,
+  Less,       // a < b into a mask
+  LessEqual,  // !(a > b) into a mask
+  And,        // of two masks
+  Select      // mask ? b : c
+};
+
+// one step of a kernel; value and mask registers are numbered separately
+struct Instr
+{
+  Op op;
+  size_t dst, a, b, c;
+};
+
+// where a value register gets its rows from
+struct Register
+{
+  enum Kind { Column, Constant, Temp };
+  Kind kind;
+  size_t column;
+  Cell constant;
+};
+
+// an expression compiled so far: a constant, which is folded into the
+// expressions using it, or a value register with bounds on its contents
+// (only tracked for s64 kernels)
+struct Value
+{
+  bool constant;
+  Cell number;
+  size_t reg;
+  int64_t lo, hi;
+};
+
+// a compiled comparison: known while compiling, or a mask register
+struct Mask
+{
+  bool constant;
+  bool truth;
+  size_t reg;
+};
+
+// what differs between f64 and s64 kernels
+template <class T> struct Lanes;
+
+template <> struct Lanes<double>
+{
+  static const CellType Type = F64Vector;
+  static bool FromConstant(const Cell& c, double& x) { x = NumberToDouble(c); return true; }
+  static bool CanDivide() { return true; }
+  static bool Bound(Op, const Value&, const Value&, Value&) { return true; }
+  static void Bounds(const std::vector<double>&, Value&) {}
+  static void Bounds(double, Value&) {}
+  static void Arith(Op op, const double* a, const double* b, double* out, size_t n)
+  {
+    if (op == Add)      simd::AddF64(a, b, out, n);
+    else if (op == Sub) simd::SubF64(a, b, out, n);
+    else if (op == Mul) simd::MulF64(a, b, out, n);
+    else                simd::DivF64(a, b, out, n);
+  }
+  static void Less(const double* a, const double* b, int64_t* m, size_t n)      { simd::LessF64(a, b, m, n); }
+  static void LessEqual(const double* a, const double* b, int64_t* m, size_t n) { simd::LessEqualF64(a, b, m, n); }
+  static void Select(const int64_t* m, const double* a, const double* b, double* out, size_t n)
+  {
+    simd::SelectF64(m, a, b, out, n);
+  }
+};
+
+template <> struct Lanes<int64_t>
+{
+  static const CellType Type = S64Vector;
+  static bool FromConstant(const Cell& c, int64_t& x)
+  {
+    if (!c.IsFixnum())
+      return false;
+    x = c.GetFixnum();
+    return true;
+  }
+  // truncating division by a column that may hold 0 is left to eval
+  static bool CanDivide() { return false; }
+
+  // r gets the range of a op b, or false if the kernel's wrapping
+  // arithmetic might overflow somewhere in it
+  static bool Bound(Op op, const Value& a, const Value& b, Value& r)
+  {
+    if (op == Add)
+      return !__builtin_add_overflow(a.lo, b.lo, &r.lo) && !__builtin_add_overflow(a.hi, b.hi, &r.hi);
+    if (op == Sub)
+      return !__builtin_sub_overflow(a.lo, b.hi, &r.lo) && !__builtin_sub_overflow(a.hi, b.lo, &r.hi);
+    int64_t p[4];
+    if (__builtin_mul_overflow(a.lo, b.lo, &p[0]) || __builtin_mul_overflow(a.lo, b.hi, &p[1]) ||
+        __builtin_mul_overflow(a.hi, b.lo, &p[2]) || __builtin_mul_overflow(a.hi, b.hi, &p[3]))
+      return false;
+    r.lo = simd::MinS64(p, 4);
+    r.hi = simd::MaxS64(p, 4);
+    return true;
+  }
+  static void Bounds(int64_t x, Value& v)
+  {
+    v.lo = v.hi = x;
+  }
+  static void Bounds(const std::vector<int64_t>& column, Value& v)
+  {
+    v.lo = column.empty() ? 0 : simd::MinS64(column.data(), column.size());
+    v.hi = column.empty() ? 0 : simd::MaxS64(column.data(), column.size());
+  }
+  static void Arith(Op op, const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+  {
+    if (op == Add)      simd::AddS64(a, b, out, n);
+    else if (op == Sub) simd::SubS64(a, b, out, n);
+    else                simd::MulS64(a, b, out, n);
+  }
+  static void Less(const int64_t* a, const int64_t* b, int64_t* m, size_t n)      { simd::LessS64(a, b, m, n); }
+  static void LessEqual(const int64_t* a, const int64_t* b, int64_t* m, size_t n) { simd::LessEqualS64(a, b, m, n); }
+  static void Select(const int64_t* m, const int64_t* a, const int64_t* b, int64_t* out, size_t n)
+  {
+    simd::SelectS64(m, a, b, out, n);
+  }
+};
+
+// a lambda's body compiled for one element type
+template <class T>
+class Kernel
+{
+public:
+  Kernel(const Builtins& builtins, const Cell& lambda, const std::vector<const std::vector<T>*>& columns)
+  : m_builtins(builtins), m_lambda(lambda), m_columns(columns), m_masks(0)
+  {
+  }
+
+  // false if the body uses anything a kernel cannot do
+  bool Compile()
+  {
+    const Cells& params = m_lambda.GetList()[1].GetList();
+    for (size_t i = 0; i < params.size(); ++i)
+      if (params[i].GetType() != Symbol)
+        return false;
+    return CompileValue(m_lambda.GetList()[2], m_result);
+  }
+
+  Cell Run(size_t n) const
+  {
+    std::shared_ptr<PackedVector<T> > out(new PackedVector<T>(n));
+    std::vector<std::vector<T> > storage(m_registers.size());
+    std::vector<const T*> src(m_registers.size());
+    std::vector<T*> dst(m_registers.size());
+    for (size_t r = 0; r < m_registers.size(); ++r)
+    {
+      T x = T();
+      if (m_registers[r].kind == Register::Constant)
+        Lanes<T>::FromConstant(m_registers[r].constant, x);
+      if (m_registers[r].kind != Register::Column)
+        storage[r].assign(Batch, x);
+      src[r] = dst[r] = storage[r].data();
+    }
+    std::vector<std::vector<int64_t> > masks(m_masks, std::vector<int64_t>(Batch));
+
+    T fill = T();
+    if (m_result.constant)
+      Lanes<T>::FromConstant(m_result.number, fill);
+    for (size_t offset = 0; offset < n; offset += Batch)
+    {
+      size_t rows = n - offset < Batch ? n - offset : Batch;
+      T* result = out->m_data.data() + offset;
+      for (size_t r = 0; r < m_registers.size(); ++r)
+        if (m_registers[r].kind == Register::Column)
+          src[r] = m_columns[m_registers[r].column]->data() + offset;
+      // the last step writes straight into the result
+      if (!m_result.constant && m_registers[m_result.reg].kind == Register::Temp)
+        src[m_result.reg] = dst[m_result.reg] = result;
+
+      for (size_t i = 0; i < m_code.size(); ++i)
+      {
+        const Instr& in = m_code[i];
+        switch (in.op)
+        {
+        case Less:      Lanes<T>::Less(src[in.a], src[in.b], masks[in.dst].data(), rows); break;
+        case LessEqual: Lanes<T>::LessEqual(src[in.a], src[in.b], masks[in.dst].data(), rows); break;
+        case And:       simd::AndMask(masks[in.a].data(), masks[in.b].data(), masks[in.dst].data(), rows); break;
+        case Select:    Lanes<T>::Select(masks[in.a].data(), src[in.b], src[in.c], dst[in.dst], rows); break;
+        default:        Lanes<T>::Arith(in.op, src[in.a], src[in.b], dst[in.dst], rows); break;
+        }
+      }
+
+      if (m_result.constant)
+        std::fill(result, result + rows, fill);
+      else if (src[m_result.reg] != result)
+        std::copy(src[m_result.reg], src[m_result.reg] + rows, result);
+    }
+    return Cell(Lanes<T>::Type, out);
+  }
+
+private:
+  // the parameter index of symbol x, or -1
+  int Param(const Cell& x) const
+  {
+    const Cells& params = m_lambda.GetList()[1].GetList();
+    for (size_t i = 0; i < params.size(); ++i)
+      if (params[i].GetVal() == x.GetVal())
+        return int(i);
+    return -1;
+  }
+
+  // the builtin that the operator x is bound to, or nullptr
+  Cell::Proc2Type Operator(const Cell& x) const
+  {
+    Cell proc;
+    if (x.GetType() == Guarded)
+      return Operator(x.GetObject<GuardedExpr>()->Current());
+    // a global the optimizer resolved, or a name looked up now
+    if (!Quoted(x, proc) && (x.GetType() != Symbol || Param(x) >= 0 || !m_lambda.GetEnv()->lookup(x.GetVal(), proc)))
+      return nullptr;
+    if (proc.GetType() != Proc || proc.GetArity() != 2)
+      return nullptr;
+    return proc.GetProc2();
+  }
+
+  size_t NewRegister(Register::Kind kind, size_t column, const Cell& constant)
+  {
+    Register r = { kind, column, constant };
+    m_registers.push_back(r);
+    return m_registers.size() - 1;
+  }
+
+  bool Materialize(Value& v)
+  {
+    T x;
+    if (!v.constant)
+      return true;
+    if (!Lanes<T>::FromConstant(v.number, x))
+      return false;
+    v.constant = false;
+    v.reg = NewRegister(Register::Constant, 0, v.number);
+    Lanes<T>::Bounds(x, v);
+    return true;
+  }
+
+  bool CompileValue(const Cell& x, Value& v)
+  {
+    v.constant = false;
+    if (x.GetType() == Guarded)
+      return CompileValue(x.GetObject<GuardedExpr>()->Current(), v);
+    if (x.GetType() == Number)
+    {
+      v.constant = true;
+      v.number = x;
+      return true;
+    }
+    if (x.GetType() == Symbol)
+    {
+      int param = Param(x);
+      if (param >= 0)
+      {
+        v.reg = NewRegister(Register::Column, size_t(param), Cell());
+        Lanes<T>::Bounds(*m_columns[param], v);
+        return true;
+      }
+      Cell bound;
+      if (!m_lambda.GetEnv()->lookup(x.GetVal(), bound) || bound.GetType() != Number)
+        return false;
+      v.constant = true;
+      v.number = bound;
+      return true;
+    }
+    if (x.GetType() != List || x.ListSize() == 0)
+      return false;
+
+    const Cells& xs = x.GetList();
+    if (xs[0].GetType() == Symbol && xs[0].GetVal() == "if")
+    {
+      Mask test;
+      Value conseq, alt;
+      if (xs.size() != 4 || !CompileMask(xs[1], test))
+        return false;
+      if (test.constant)
+        return CompileValue(test.truth ? xs[2] : xs[3], v);
+      if (!CompileValue(xs[2], conseq) || !CompileValue(xs[3], alt) || !Materialize(conseq) || !Materialize(alt))
+        return false;
+      v.reg = NewRegister(Register::Temp, 0, Cell());
+      v.lo = conseq.lo < alt.lo ? conseq.lo : alt.lo;
+      v.hi = conseq.hi > alt.hi ? conseq.hi : alt.hi;
+      Instr in = { Select, v.reg, test.reg, conseq.reg, alt.reg };
+      m_code.push_back(in);
+      return true;
+    }
+
+    Cell::Proc2Type proc = Operator(xs[0]);
+    Op op;
+    if (!proc)
+      return false;
+    else if (proc == m_builtins.add) op = Add;
+    else if (proc == m_builtins.sub) op = Sub;
+    else if (proc == m_builtins.mul) op = Mul;
+    else if (proc == m_builtins.div) op = Div;
+    else
+      return false;
+    if (op == Div && !Lanes<T>::CanDivide())
+      return false;
+
+    // the variadic forms fold from the left; * starts from 1
+    if (xs.size() == 1 && op != Mul)
+      return false;
+    size_t i = 1;
+    if (op == Mul)
+    {
+      v.constant = true;
+      v.number = MakeFixnum(1);
+    }
+    else if (!CompileValue(xs[i++], v))
+      return false;
+    for (; i < xs.size(); ++i)
+    {
+      Value b;
+      if (!CompileValue(xs[i], b) || !Arithmetic(op, v, b))
+        return false;
+    }
+    return true;
+  }
+
+  // a = a op b
+  bool Arithmetic(Op op, Value& a, Value& b)
+  {
+    if (a.constant && b.constant)
+    {
+      // fold exactly, as eval would; a fixnum division by zero is left
+      // to eval to report
+      if (op == Div && !b.number.IsReal() && !a.number.IsReal() && b.number.IsFixnum() && b.number.GetFixnum() == 0)
+        return false;
+      a.number = op == Add ? NumberAdd(a.number, b.number) :
+                 op == Sub ? NumberSub(a.number, b.number) :
+                 op == Mul ? NumberMul(a.number, b.number) : NumberDiv(a.number, b.number);
+      return true;
+    }
+    Value r;
+    r.constant = false;
+    if (!Materialize(a) || !Materialize(b) || !Lanes<T>::Bound(op, a, b, r))
+      return false;
+    r.reg = NewRegister(Register::Temp, 0, Cell());
+    Instr in = { op, r.reg, a.reg, b.reg, 0 };
+    m_code.push_back(in);
+    a = r;
+    return true;
+  }
+
+  bool CompileMask(const Cell& x, Mask& m)
+  {
+    if (x.GetType() == Guarded)
+      return CompileMask(x.GetObject<GuardedExpr>()->Current(), m);
+    if (x.GetType() != List || x.ListSize() < 3)
+      return false;
+    const Cells& xs = x.GetList();
+    Cell::Proc2Type proc = Operator(xs[0]);
+    if (!proc || (proc != m_builtins.less && proc != m_builtins.greater && proc != m_builtins.lessEqual))
+      return false;
+
+    // like the primitives, compare the first argument with each of the others
+    Value first;
+    if (!CompileValue(xs[1], first))
+      return false;
+    m.constant = true;
+    m.truth = true;
+    for (size_t i = 2; i < xs.size(); ++i)
+    {
+      Value other;
+      Mask c;
+      if (!CompileValue(xs[i], other) || !Compare(proc, first, other, c))
+        return false;
+      if (c.constant && !c.truth)
+      {
+        m = c;
+        return true;
+      }
+      if (c.constant)
+        continue;
+      if (m.constant)
+        m = c;
+      else
+      {
+        size_t reg = m_masks++;
+        Instr in = { And, reg, m.reg, c.reg, 0 };
+        m_code.push_back(in);
+        m.reg = reg;
+      }
+    }
+    return true;
+  }
+
+  bool Compare(Cell::Proc2Type proc, Value& a, Value& b, Mask& m)
+  {
+    if (a.constant && b.constant)
+    {
+      int c = NumberCompare(a.number, b.number);
+      m.constant = true;
+      m.truth = proc == m_builtins.less ? c < 0 : proc == m_builtins.greater ? c > 0 : c <= 0;
+      return true;
+    }
+    if (!Materialize(a) || !Materialize(b))
+      return false;
+    m.constant = false;
+    m.reg = m_masks++;
+    // a > b is b < a
+    Instr in = { proc == m_builtins.lessEqual ? LessEqual : Less, m.reg, a.reg, b.reg, 0 };
+    if (proc == m_builtins.greater)
+      std::swap(in.a, in.b);
+    m_code.push_back(in);
+    return true;
+  }
+
+  const Builtins& m_builtins;
+  const Cell& m_lambda;
+  const std::vector<const std::vector<T>*>& m_columns;
+  std::vector<Register> m_registers;
+  std::vector<Instr> m_code;
+  size_t m_masks;
+  Value m_result;
+};
+
+template <class T>
+bool TryKernel(const Builtins& builtins, const Cell& f, const Cells& args, size_t n, Cell& result)
+{
+  std::vector<const std::vector<T>*> columns;
+  for (size_t i = 1; i < args.size(); ++i)
+    columns.push_back(&args[i].GetObject<PackedVector<T> >()->m_data);
+  Kernel<T> kernel(builtins, f, columns);
+  if (!kernel.Compile())
+    return false;
+  result = kernel.Run(n);
+  return true;
+}
+
+Cell RowCell(const Cell& column, size_t i)
+{
+  if (column.GetType() == F64Vector)
+    return MakeReal(column.GetObject<F64Data>()->m_data[i]);
+  return MakeFixnum(column.GetObject<S64Data>()->m_data[i]);
+}
+
+size_t Rows(const Cell& column)
+{
+  if (column.GetType() == F64Vector)
+    return column.GetObject<F64Data>()->m_data.size();
+  return column.GetObject<S64Data>()->m_data.size();
+}
+
+// apply f row by row
+Cell Fallback(const Cell& f, const Cells& args, size_t n, bool allS64)
+{
+  Cells results;
+  results.reserve(n);
+  bool fixnums = allS64;
+  Cells row(args.size() - 1);
+  for (size_t i = 0; i < n; ++i)
+  {
+    for (size_t k = 1; k < args.size(); ++k)
+      row[k - 1] = RowCell(args[k], i);
+    results.push_back(Apply(f, row));
+    fixnums = fixnums && results.back().GetType() == Number && results.back().IsFixnum();
+  }
+  if (fixnums)
+  {
+    std::shared_ptr<S64Data> out(new S64Data(n));
+    for (size_t i = 0; i < n; ++i)
+      out->m_data[i] = results[i].GetFixnum();
+    return Cell(S64Vector, out);
+  }
+  std::shared_ptr<F64Data> out(new F64Data(n));
+  for (size_t i = 0; i < n; ++i)
+    out->m_data[i] = NumberToDouble(results[i]);
+  return Cell(F64Vector, out);
+}
+
+Cell proc_vmap(const Builtins& builtins, const Cells& args)
+{
+  const Cell& f = args[0];
+  bool allF64 = true, allS64 = true;
+  size_t n = 0;
+  for (size_t i = 1; i < args.size(); ++i)
+  {
+    if (args[i].GetType() != F64Vector && args[i].GetType() != S64Vector)
+    {
+      std::cout << "vmap needs f64vector or s64vector columns: " << args[i].ToString() << "\n";
+      exit(1);
+    }
+    if (i > 1 && Rows(args[i]) != n)
+    {
+      std::cout << "vmap columns differ in length\n";
+      exit(1);
+    }
+    n = Rows(args[i]);
+    allF64 = allF64 && args[i].GetType() == F64Vector;
+    allS64 = allS64 && args[i].GetType() == S64Vector;
+  }
+
+  if (f.GetType() == Lambda)
+  {
+    if (f.GetList()[1].ListSize() != args.size() - 1)
+    {
+      std::cout << "wrong number of arguments\n";
+      exit(1);
+    }
+    Cell result;
+    if (allF64 && TryKernel<double>(builtins, f, args, n, result))
+      return result;
+    if (allS64 && TryKernel<int64_t>(builtins, f, args, n, result))
+      return result;
+  }
+  return Fallback(f, args, n, allS64);
+}
+
+}
+
+void mu::AddVmapGlobals(Env& env)
+{
+  Builtins builtins(env);
+  env["vmap"] = Cell(Proc, std::make_shared<NativeProc>("vmap", Signature::Variadic(2),
+    [builtins](const Cells& args) { return proc_vmap(builtins, args); }));
+}
@@ -0,0 +1,26 @@
+#ifndef __MU_VMAP_HPP__
+#define __MU_VMAP_HPP__
+
+#include "cell.hpp"
+#include "env.hpp"
+
+namespace mu {
+
+// register (vmap f column ...), which calls f once per row of the given
+// f64vector or s64vector columns and returns the results as a vector: an
+// s64vector when every column is one and every result is a fixnum, else
+// an f64vector.
+//
+// A lambda whose body only uses its parameters, numbers bound in its
+// Env, + - * / < > <= and if is compiled once into a kernel that runs
+// over batches of rows with the SIMD kernels, computing both arms of an
+// if and selecting between them. s64 kernels are only used when bounds
+// taken from the columns prove that nothing overflows. Anything else,
+// including a redefined +, is applied row by row.
+//
+// env must already hold the arithmetic primitives.
+void AddVmapGlobals(Env& env);
+
+}
+
+#endif